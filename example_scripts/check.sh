@@ -0,0 +1,22 @@
+#!/bin/sh
+# Runs every script that has a .expected file next to it under each engine
+# and optimization level, and diffs what it prints against that file.
+# usage: check.sh [path to ghost]
+ghost=${1:-./ghost}
+dir=$(dirname "$0")
+status=0
+for expected in "$dir"/*.expected; do
+    script="${expected%.expected}.gs"
+    for engine in ast vm flat; do
+        for level in -O0 -O1; do
+            if "$ghost" -e $engine $level -f "$script" | diff -u "$expected" - > /dev/null; then
+                echo "ok   $(basename "$script") -e $engine $level"
+            else
+                echo "FAIL $(basename "$script") -e $engine $level"
+                "$ghost" -e $engine $level -f "$script" | diff -u "$expected" -
+                status=1
+            fi
+        done
+    done
+done
+exit $status
@@ -0,0 +1,12 @@
+def mk(let n) {
+    let a := [n, n + 1, n + 2, [n, n]];
+    return a;
+}
+let i := 0;
+let keep := 0;
+while (i < 100000) {
+    let t := mk(i);
+    keep := first(rest(t));
+    i := i + 1;
+}
+println keep;
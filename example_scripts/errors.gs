@@ -0,0 +1,36 @@
+def add(let a, let b) {
+    return a + b;
+}
+def one(let a) {
+    return a;
+}
+def tail(let n) {
+    return one(n, 2);
+}
+def tailnf(let n) {
+    return n(1);
+}
+let x := 5;
+println add(1);
+println add(1, 2, 3);
+println add(1, 2);
+println x(1);
+println nothere(2);
+println tail(3);
+println tailnf(4);
+println map([1, 2], 3);
+println filter([1, 2], x);
+let r := x(1);
+println r;
+let i := 0;
+while (i < 3) {
+    println x(i);
+    i := i + 1;
+}
+println add(x(1), 2);
+println one();
+println size(x);
+println first(x);
+println get(x, 1);
+println keys(x);
+println "done";
@@ -0,0 +1,14 @@
+def fib(let n) {
+    if (n < 2) {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+let i := 0;
+let total := 0;
+while (i < 2000) {
+    total := total + i % 7;
+    i := i + 1;
+}
+println total;
+println fib(18);
@@ -0,0 +1,24 @@
+def fill(let a, let n) {
+    let j := 0;
+    while (j < n) {
+        append(a, j);
+        j := j + 1;
+    }
+    return a;
+}
+let i := 0;
+let kept := 0;
+while (i < 2000) {
+    let a := fill([], 1000);
+    let d := {};
+    let m := ordered {};
+    let j := 0;
+    while (j < 100) {
+        d[j] := a;
+        m[j] := j;
+        j := j + 1;
+    }
+    kept := size(a) + size(d) + size(m);
+    i := i + 1;
+}
+println kept;
@@ -0,0 +1,20 @@
+def sum(let n) {
+    if (n == 0) {
+        return 0;
+    }
+    return n + sum(n - 1);
+}
+def tak(let x, let y, let z) {
+    if (y < x) {
+        return tak(tak(x - 1, y, z), tak(y - 1, z, x), tak(z - 1, x, y));
+    }
+    return z;
+}
+let i := 0;
+let total := 0;
+while (i < 100) {
+    total := total + sum(100);
+    i := i + 1;
+}
+println total;
+println tak(12, 6, 0);
@@ -1,28 +1,91 @@
 #ifndef buffer_hpp
 #define buffer_hpp
 #include <iostream>
-#include <fstream>
-#include <vector>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 using namespace std;
 
+//a run of source text, by position rather than by copy
+struct Span {
+    int offset;
+    int length;
+    Span(int off = 0, int len = 0) : offset(off), length(len) { }
+};
+
+//The lexer walks one contiguous block of source, subclasses only decide
+//where that block lives. Token text is read out of it as spans, nothing
+//keeps pointing into it once lexing is done.
 class CharBuffer {
+    protected:
+        const char* data;
+        int size;
+        int pos;
+        int start;
+        int line;
+        int lineStart;
+        int counted;
+        void attach(const char* text, int length) {
+            data = text;
+            size = length;
+            pos = 0;
+            start = 0;
+            line = 1;
+            lineStart = 0;
+            counted = 0;
+        }
     public:
+        CharBuffer() {
+            attach("", 0);
+        }
         virtual ~CharBuffer() {
 
-        } 
-        virtual void advance() = 0;
-        virtual bool done() = 0;
-        virtual char get() = 0;
-        virtual int markStart() = 0;
-        virtual string sliceFromStart(int matchlen) = 0;
+        }
+        void advance() {
+            pos++;
+        }
+        void rewind() {
+            if (pos > 0) pos--;
+        }
+        bool done() {
+            return pos >= size;
+        }
+        char get() {
+            return pos < size ? data[pos]:'\0';
+        }
+        //token starts only move forward, so lines are counted here rather
+        //than on every advance()
+        int markStart() {
+            start = pos;
+            for (; counted < start; counted++) {
+                if (data[counted] == '\n') {
+                    line++;
+                    lineStart = counted + 1;
+                }
+            }
+            return start;
+        }
+        int startLine() {
+            return line;
+        }
+        int startColumn() {
+            return start - lineStart + 1;
+        }
+        Span spanFromStart(int matchlen) {
+            return Span(start, matchlen + 1);
+        }
+        string_view view(Span span) {
+            return string_view(data + span.offset, span.length);
+        }
 };
 
 
 class StringBuffer : public CharBuffer {
     private:
         string buff;
-        int spos;
-        int start;
     public:
         StringBuffer() {
 
@@ -32,108 +95,59 @@ class StringBuffer : public CharBuffer {
         }
         void init(string str) {
             buff = str;
-            spos = 0;
-        }
-        int markStart() {
-            start = spos;
-            return start;
-        }
-        string sliceFromStart(int matchlen) {
-            string slice;
-            for (int i = start; i <= start+matchlen; i++)
-                slice.push_back(buff[i]);
-            return slice;
-        }
-        char get() {
-            return buff[spos];
-        }
-        bool done() {
-            return spos >= buff.size();
-        }
-        void advance() {
-            spos++;
+            attach(buff.data(), buff.size());
         }
 };
 
 
-class FileStringBuffer : public CharBuffer {
+//maps the script read only, the lexer reads straight out of the page cache
+class MappedFileBuffer : public CharBuffer {
     private:
-        vector<string> lines;
-        int line_pos;
-        int str_pos;
-        int start;
-        int line_start;
-        void read(std::string fname) {
-            ifstream gfile(fname, ios::in);
-            if (!gfile.is_open()) {
-                cout<<"Couldnt open "<<fname<<endl;
-                return;
-            }
-            string buff;
-            while (gfile.good()) {
-                getline(gfile, buff);
-                lines.push_back(buff);
-            }
+        void* mapping;
+        size_t mappedLength;
+        void release() {
+            if (mapping != nullptr)
+                munmap(mapping, mappedLength);
+            mapping = nullptr;
+            mappedLength = 0;
+            attach("", 0);
         }
     public:
-        FileStringBuffer() {
-            line_pos = 0;
-            str_pos = 0;
-            start = 0;
-            line_start = 0;
+        MappedFileBuffer() {
+            mapping = nullptr;
+            mappedLength = 0;
         }
-        ~FileStringBuffer() {
-
-        }
-        int markStart() {
-            start = str_pos;
-            line_start = line_pos;
-            return start;
+        ~MappedFileBuffer() {
+            release();
         }
-        string sliceFromStart(int matchlen) {
-            string slice;
-            int j = 0, t = 0;
-            for (int k = line_start; k <= line_pos && j <= matchlen; k++) {
-                for (int n = t > 0 ? 0:start; n < lines[line_pos].length() && j <= matchlen; n++, j++) {
-                    slice.push_back(lines[k][n]);
-                }
-                t++;
+        bool readFile(string fname) {
+            release();
+            int fd = open(fname.c_str(), O_RDONLY);
+            if (fd < 0) {
+                cout<<"Couldnt open "<<fname<<endl;
+                return false;
             }
-            return slice;
-        }
-        void advance() {
-            if (line_pos < lines.size()) {
-                if (str_pos < lines[line_pos].size()) {
-                    str_pos++;
-                } else {
-                    line_pos++;
-                    str_pos = 0;
-                }
+            struct stat st;
+            if (fstat(fd, &st) < 0) {
+                cout<<"Couldnt open "<<fname<<endl;
+                close(fd);
+                return false;
             }
-        }
-        void rewind() {
-            if (done()) {
-                line_pos = lines.size()-1;
-                str_pos = lines[line_pos].length()-1;
-            } else {
-                if (str_pos > 0) {
-                    str_pos--;
-                } else {
-                    line_pos--;
-                    str_pos = lines[line_pos].length()-1;
+            //mmap refuses zero length mappings, an empty script is just empty
+            if (st.st_size > 0) {
+                void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (m == MAP_FAILED) {
+                    cout<<"Couldnt map "<<fname<<endl;
+                    close(fd);
+                    return false;
                 }
+                mapping = m;
+                mappedLength = st.st_size;
+                madvise(mapping, mappedLength, MADV_SEQUENTIAL);
+                attach((const char*)mapping, mappedLength);
             }
-        }
-        char get() {
-            return lines[line_pos][str_pos];
-        }
-        bool done() {
-            return line_pos == lines.size() && str_pos == lines[line_pos].size();
-        }
-        void readFile(string fname) {
-            read(fname);
-            line_pos = 0;
-            str_pos = 0;
+            close(fd);
+            return true;
         }
 };
 
@@ -0,0 +1,36 @@
+#ifndef intern_hpp
+#define intern_hpp
+#include <iostream>
+#include <deque>
+#include <string_view>
+#include <unordered_map>
+using namespace std;
+
+//Identifiers and string literals are interned once by the lexer, after
+//that everything downstream compares and hashes them by their atom.
+//Atoms are handed out densely from 0 and are never released.
+class InternTable {
+    private:
+        deque<string> names;
+        unordered_map<string_view, int> ids;
+    public:
+        int intern(string_view str) {
+            auto it = ids.find(str);
+            if (it != ids.end())
+                return it->second;
+            names.push_back(string(str));
+            int atom = names.size() - 1;
+            ids.emplace(string_view(names.back()), atom);
+            return atom;
+        }
+        const string& nameOf(int atom) {
+            return names[atom];
+        }
+        int size() {
+            return names.size();
+        }
+};
+
+InternTable atoms;
+
+#endif
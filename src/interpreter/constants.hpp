@@ -0,0 +1,57 @@
+#ifndef constants_hpp
+#define constants_hpp
+#include <iostream>
+#include <cstring>
+#include <vector>
+#include <unordered_map>
+#include "object.hpp"
+using namespace std;
+
+//Literals of a program decoded once, when the program is resolved, so
+//evaluating one is a load rather than a parse. Equal literals share an
+//entry. Numbers are immediate (an integer too wide to NaN-box is boxed
+//and pinned) and string literals are the pinned shared StringObjects, so
+//nothing in here needs marking.
+class ConstantPool {
+    private:
+        vector<Object> values;
+        unordered_map<uint64_t, int> numbers;
+        unordered_map<int64_t, int> integers;
+        unordered_map<int, int> strings;
+    public:
+        int addNumber(double value) {
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            auto it = numbers.find(bits);
+            if (it != numbers.end())
+                return it->second;
+            values.push_back(Object(value));
+            numbers[bits] = values.size() - 1;
+            return values.size() - 1;
+        }
+        int addInteger(int64_t value) {
+            auto it = integers.find(value);
+            if (it != integers.end())
+                return it->second;
+            values.push_back(Object(value));
+            heap.pin(values.back());
+            integers[value] = values.size() - 1;
+            return values.size() - 1;
+        }
+        int addString(int atom) {
+            auto it = strings.find(atom);
+            if (it != strings.end())
+                return it->second;
+            values.push_back(Object(internedString(atom)));
+            strings[atom] = values.size() - 1;
+            return values.size() - 1;
+        }
+        Object& get(int index) {
+            return values[index];
+        }
+        int size() {
+            return values.size();
+        }
+};
+
+#endif
@@ -10,13 +10,27 @@
 #include "object.hpp"
 using namespace std;
 
-struct Scope {
-    unordered_map<string, Object> bindings;
+//bindings live in a flat frame indexed by the slot ScopeResolver assigned them
+struct Scope : public GCObject {
+    vector<Object> slots;
     Scope* enclosing;
     Scope* control;
-    Scope(Scope* enc = nullptr, Scope* dyn = nullptr) : enclosing(enc), control(dyn) { }
+    Scope(Scope* enc = nullptr, Scope* dyn = nullptr, int frameSize = 0) : slots(frameSize), enclosing(enc), control(dyn) { }
+    //control is only followed for the active chain, see Context::markRoots
+    void trace(Heap& heap) {
+        for (Object& m : slots)
+            heap.mark(m);
+        heap.mark(enclosing);
+    }
+    size_t footprint() {
+        return sizeof(Scope) + slots.capacity()*sizeof(Object);
+    }
 };
 
+void Function::trace(Heap& heap) {
+    heap.mark(closure);
+}
+
 class Context {
     private:
         Scope* scopes;
@@ -34,25 +48,28 @@ class Context {
             }
             return x;
         }
-        unordered_map<string, ClassObject*> userTypes;
+        unordered_map<int, ClassObject*> userTypes;
     public:
         Context() {
-            global = new Scope();
+            global = heap.make<Scope>();
             global->enclosing = global;
             global->control = global;
             scopes = global;
         }
-        void putAt(string name, Object obj, int depth) {
-            //cout<<"Put {"<<name<<":"<<obj.toString()<<"} at depth "<<depth<<endl;
-            at(depth)->bindings[name] = obj;
+        void putAt(int slot, Object obj, int depth) {
+            Scope* x = at(depth);
+            if (slot < 0)
+                return;
+            //the global frame grows as the REPL introduces new names
+            if ((size_t)slot >= x->slots.size())
+                x->slots.resize(slot+1);
+            x->slots[slot] = obj;
         }
-        Object& getAt(string name, int depth) {
-            //cout<<"Get "<<name<<" at depth "<<depth<<endl;
+        Object& getAt(int slot, int depth) {
             Scope* x = at(depth);
-            if (x->bindings.find(name) != x->bindings.end())
-                return x->bindings[name];
-            //cout<<"\nHrm.."<<endl;
-            return nilInfo;
+            if (slot < 0 || (size_t)slot >= x->slots.size())
+                return nilInfo;
+            return x->slots[slot];
         }
         Scope* getStack() {
             return scopes;
@@ -63,17 +80,25 @@ class Context {
         void closeScope() {
             scopes = scopes->control;
         }
-        void addClassDef(string name, ClassObject* obj) {
+        void addClassDef(int name, ClassObject* obj) {
             userTypes.insert(make_pair(name, obj));
         }
-        ClassObject* getClassDef(string name) {
-            if (userTypes.find(name) != userTypes.end())
-                return userTypes[name];
-            return nullptr;
+        ClassObject* getClassDef(int name) {
+            auto it = userTypes.find(name);
+            return it == userTypes.end() ? nullptr:it->second;
         }
         Object& getNil() {
             return nilInfo;
         }
+        //the active scope chain is reached through the control links,
+        //everything else hangs off of it through enclosing scopes.
+        void markRoots(Heap& heap) {
+            heap.mark(global);
+            for (Scope* x = scopes; x != nullptr && x != global; x = x->control)
+                heap.mark(x);
+            for (auto& t : userTypes)
+                heap.mark(t.second);
+        }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,579 @@
+#ifndef evaluator_hpp
+#define evaluator_hpp
+#include <cmath>
+#include "../interpreter.hpp"
+#include "flatast.hpp"
+using namespace std;
+
+//Evaluates a FlatTree with one switch over the node kind. Semantics are
+//the tree walking Interpreter's, statement for statement: the same value
+//stack discipline, completions, tail call trampoline and Scope chains,
+//only the dispatch and the operand fetches are different.
+class FlatEvaluator : public RootSet {
+    private:
+        Context cxt;
+        InspectableStack<Object> sf;
+        Completion completion;
+        Scope* tailEnv;
+        int loopDepth;
+        FlatTree* tree;
+        //columns of the tree, refreshed before every run since appending
+        //to the tree can move them
+        uint8_t* kind;
+        uint8_t* op;
+        int* a;
+        int* b;
+        int* c;
+        int* lists;
+        void attach(FlatTree* t) {
+            tree = t;
+            kind = tree->kind.data();
+            op = tree->op.data();
+            a = tree->a.data();
+            b = tree->b.data();
+            c = tree->c.data();
+            lists = tree->lists.data();
+        }
+        Object assignOp(int sym, Object lhs, Object rhs) {
+            switch (sym) {
+                case TK_ASSIGN_SUM: return add(lhs, rhs);
+                case TK_ASSIGN_DIFF: return sub(lhs, rhs);
+                default: break;
+            }
+            return rhs;
+        }
+        void setIndex(int n) {
+            eval(a[n]);
+            eval(b[n]);
+            eval(c[n]);
+            //the container, subscript and value stay on the stack until the
+            //assignment is done so a collection can't pull them out from under us
+            Object m = sf.get(sf.size() - 3);
+            Object result;
+            if (m.type() == ARRAY) {
+                Object& slot = m.arr()->at(sf.get(sf.size() - 2).intval());
+                slot = assignOp(op[n], slot, sf.top());
+                result = slot;
+            } else if (m.type() == DICT) {
+                Object& slot = m.dict()->at(sf.get(sf.size() - 2));
+                slot = assignOp(op[n], slot, sf.top());
+                result = slot;
+            } else if (m.type() == ORDERED) {
+                Object& slot = m.ordered()->at(sf.get(sf.size() - 2));
+                slot = assignOp(op[n], slot, sf.top());
+                result = slot;
+            }
+            sf.pop(); sf.pop(); sf.pop();
+            sf.push(result);
+        }
+        void setField(int n) {
+            eval(a[n]);
+            eval(c[n]);
+            Object m = sf.get(sf.size() - 2);
+            Object result;
+            if (m.type() == OBJECT) {
+                ClassObject* co = m.clazz();
+                auto field = co->fields.find(b[n]);
+                if (field == co->fields.end()) {
+                    cout<<atoms.nameOf(b[n])<<"? never heard of it for a  "<<co->getTypeName()<<endl;
+                } else {
+                    field->second = assignOp(op[n], field->second, sf.top());
+                    result = field->second;
+                }
+            }
+            sf.pop(); sf.pop();
+            sf.push(result);
+        }
+        void handleRegExMatch(Object txt, Object pat) {
+            string text = txt.toString();
+            text = text.substr(1, text.length()-2);
+            string pattern = pat.toString();
+            pattern = pattern.substr(1, pattern.length()-2);
+            sf.push(Object(matchRegEx(pattern, text)));
+        }
+        void binary(int n) {
+            eval(a[n]);
+            eval(b[n]);
+            Object rhs = sf.pop();
+            Object lhs = sf.pop();
+            switch (op[n]) {
+                case TK_ADD: sf.push(add(lhs, rhs)); break;
+                case TK_SUB: sf.push(sub(lhs, rhs)); break;
+                case TK_MUL: sf.push(mul(lhs, rhs)); break;
+                case TK_DIV: sf.push(div(lhs, rhs)); break;
+                case TK_MOD: sf.push(mod(lhs, rhs)); break;
+                case TK_LT:  sf.push(lt(lhs, rhs)); break;
+                case TK_GT:  sf.push(gt(lhs, rhs)); break;
+                case TK_LTE: sf.push(lte(lhs, rhs)); break;
+                case TK_GTE: sf.push(gte(lhs, rhs)); break;
+                case TK_EQ:  sf.push(equ(lhs, rhs)); break;
+                case TK_NEQ: sf.push(neq(lhs, rhs)); break;
+                case TK_MATCHRE: handleRegExMatch(lhs, rhs); break;
+                case TK_AND: sf.push(Object(lhs.boolval() && rhs.boolval())); break;
+                case TK_OR:  sf.push(Object(lhs.boolval() || rhs.boolval())); break;
+                default:
+                    sf.push(Object());
+                    break;
+            }
+        }
+        Function* makeFunction(int fn) {
+            FlatFunction& ff = tree->functions[fn];
+            Function* func = heap.make<Function>();
+            func->body = ff.astBody;
+            func->params = ff.params;
+            func->name = ff.name;
+            func->closure = cxt.getStack();
+            func->frameSize = ff.frameSize;
+            func->entry = fn;
+            return func;
+        }
+        //arguments are evaluated onto the stack before the frame exists,
+        //then moved into it.
+        Scope* evaluateArguments(Function* func, int start, int count) {
+            int base = sf.size();
+            for (int i = 0; i < count; i++)
+                eval(lists[start + i]);
+            Scope* scope = heap.make<Scope>(func->closure, cxt.getStack(), func->frameSize);
+            FlatFunction& ff = tree->functions[func->entry];
+            if (ff.paramCount != count) {
+                cout<<"Error: function call has mismatched arguments."<<endl;
+            }
+            for (int i = 0; i < ff.paramCount && base + i < sf.size(); i++)
+                scope->slots[lists[ff.paramStart + i]] = sf.get(base + i);
+            while (sf.size() > base) sf.pop();
+            return scope;
+        }
+        //a trailing expression statement is the function's value
+        void evaluateBody(int body) {
+            int start = a[body], count = b[body];
+            for (int i = 0; i < count; i++) {
+                int stmt = lists[start + i];
+                heap.safepoint();
+                if (i == count - 1 && kind[stmt] == FL_EXPR_STMT) {
+                    eval(a[stmt]);
+                } else {
+                    eval(stmt);
+                    if (completion != NORMAL)
+                        break;
+                }
+            }
+        }
+        //tail calls don't recurse, they leave their callee on the stack and
+        //its frame in tailEnv, and the call is run here in place of this one
+        void applyFunction(Function* func, Scope* env) {
+            Scope* caller = cxt.getStack();
+            int base = sf.size();
+            int loops = loopDepth;
+            bool replaced = false;
+            for (;;) {
+                loopDepth = 0;
+                env->control = caller;
+                cxt.openScope(env);
+                evaluateBody(tree->functions[func->entry].body);
+                if (completion != TAILCALL)
+                    break;
+                completion = NORMAL;
+                Object callee = sf.pop();
+                while (sf.size() > base) sf.pop();
+                //the callee has to stay reachable while it runs
+                if (replaced) {
+                    sf.top() = callee;
+                } else {
+                    sf.push(callee);
+                    base++;
+                    replaced = true;
+                }
+                func = callee.func();
+                env = tailEnv;
+                tailEnv = nullptr;
+            }
+            completion = NORMAL;
+            loopDepth = loops;
+            cxt.openScope(caller);
+            if (sf.size() == base) {
+                sf.push(Object());
+            }
+            if (replaced) {
+                Object result = sf.pop();
+                sf.pop();
+                sf.push(result);
+            }
+        }
+        void call(int n) {
+            eval(a[n]);
+            Object func = sf.top();
+            if (func.type() != FUNC || func.func()->entry < 0) {
+                cout<<"Error not a function"<<endl;
+                sf.pop();
+                sf.push(Object());
+                return;
+            }
+            // eval <-> apply, the callee stays on the stack for the duration
+            Scope* env = evaluateArguments(func.func(), b[n], c[n]);
+            if (kind[n] == FL_TAIL_CALL) {
+                tailEnv = env;
+                completion = TAILCALL;
+                return;
+            }
+            applyFunction(func.func(), env);
+            Object result = sf.pop();
+            sf.pop();
+            sf.push(result);
+        }
+        //applies a function of one argument, leaving its value on the stack
+        void applyUnary(Function* func, Object arg) {
+            Scope* scope = heap.make<Scope>(func->closure, cxt.getStack(), func->frameSize);
+            FlatFunction& ff = tree->functions[func->entry];
+            if (ff.paramCount > 0)
+                scope->slots[lists[ff.paramStart]] = arg;
+            applyFunction(func, scope);
+        }
+        //the result list rides on the stack while the function is applied
+        Object doMap(Object& m, Object& lmb, bool filter) {
+            if (lmb.type() != FUNC || lmb.func()->entry < 0) {
+                cout<<"Error: "<<(filter ? "filter":"map")<<" expects a function argument"<<endl;
+                return Object();
+            }
+            ArrayObject* res = heap.make<ArrayObject>();
+            sf.push(Object(res));
+            for (size_t i = 0; i < m.arr()->size(); i++) {
+                applyUnary(lmb.func(), m.arr()->at(i));
+                if (!filter) {
+                    res->push_back(sf.pop());
+                } else if (sf.pop().boolval()) {
+                    res->push_back(m.arr()->at(i));
+                }
+            }
+            return sf.pop();
+        }
+        void listOp(int n) {
+            eval(a[n]);
+            ObjectType listType = sf.top().type();
+            if (listType != ARRAY && listType != DICT && listType != ORDERED) {
+                cout<<"Error: "<<tokenSpelling((TKSymbol)op[n])<<" expects a list."<<endl;
+                sf.pop();
+                sf.push(Object());
+                return;
+            }
+            int operands = 1;
+            if (b[n] >= 0) {
+                eval(b[n]);
+                operands++;
+            }
+            //operands stay on the stack until the operation is done
+            Object m = sf.get(sf.size() - operands);
+            Object arg = operands > 1 ? sf.top():Object();
+            Object result;
+            if (m.type() != ARRAY) {
+                result = m.type() == DICT ? dictOp(op[n], m.dict(), arg):orderedOp(op[n], m.ordered(), arg);
+                while (operands-- > 0) sf.pop();
+                sf.push(result);
+                return;
+            }
+            ArrayObject* arr = m.arr();
+            switch (op[n]) {
+                case TK_EMPTY:  result = Object(arr->empty()); break;
+                case TK_SIZE:   result = Object((int64_t)arr->size()); break;
+                case TK_FIRST:  result = arr->at(0); break;
+                case TK_LAST:   result = arr->back(); break;
+                case TK_MAP:    result = doMap(m, arg, false); break;
+                case TK_FILTER: result = doMap(m, arg, true); break;
+                case TK_POP:    result = arr->pop_front(); break;
+                case TK_REST: {
+                    ArrayObject* obj = heap.make<ArrayObject>();
+                    for (size_t i = 1; i < arr->size(); i++)
+                        obj->push_back(arr->at(i));
+                    result = Object(obj);
+                    break;
+                }
+                case TK_APPEND: arr->push_back(arg); result = m; break;
+                case TK_GET:    result = arr->at(arg.intval()); break;
+                case TK_PUSH:   arr->push_front(arg); result = m; break;
+                case TK_CONTAINS: result = Object(listContains(arr, arg)); break;
+                case TK_DELETE: result = Object(listDelete(arr, arg)); break;
+                case TK_PUT:    result = listPut(arr, arg); break;
+                case TK_REDUCE:
+                default:
+                    break;
+            }
+            while (operands-- > 0) sf.pop();
+            sf.push(result);
+        }
+        void index(int n) {
+            eval(a[n]);
+            eval(b[n]);
+            Object idx = sf.pop();
+            Object arr = sf.pop();
+            if (arr.type() == DICT) {
+                sf.push(arr.dict()->get(idx));
+                return;
+            }
+            if (arr.type() == ORDERED) {
+                sf.push(arr.ordered()->get(idx));
+                return;
+            }
+            sf.push(arr.type() == ARRAY ? arr.arr()->at(idx.intval()):Object());
+        }
+        void field(int n) {
+            eval(a[n]);
+            Object obj = sf.pop();
+            if (obj.type() != OBJECT) {
+                sf.push(Object());
+                return;
+            }
+            ClassObject* co = obj.clazz();
+            auto field = co->fields.find(b[n]);
+            if (field == co->fields.end()) {
+                cout<<atoms.nameOf(b[n])<<"? never heard of it for a  "<<co->getTypeName()<<endl;
+                sf.push(Object());
+                return;
+            }
+            sf.push(field->second);
+        }
+        void makeArray(int n) {
+            int base = sf.size();
+            for (int i = 0; i < b[n]; i++)
+                eval(lists[a[n] + i]);
+            ArrayObject* arr = heap.make<ArrayObject>(sf.size() - base);
+            for (int i = arr->size() - 1; i >= 0; i--) {
+                arr->at(i) = sf.pop();
+            }
+            sf.push(Object(arr));
+        }
+        void makeDict(int n) {
+            int base = sf.size();
+            for (int i = 0; i < b[n]; i++)
+                eval(lists[a[n] + i]);
+            if (c[n]) {
+                OrderedMapObject* map = heap.make<OrderedMapObject>();
+                for (int i = base; i < sf.size(); i += 2)
+                    map->put(sf.get(i), sf.get(i + 1));
+                while (sf.size() > base) sf.pop();
+                sf.push(Object(map));
+                return;
+            }
+            DictObject* dict = heap.make<DictObject>();
+            for (int i = base; i < sf.size(); i += 2)
+                dict->put(sf.get(i), sf.get(i + 1));
+            while (sf.size() > base) sf.pop();
+            sf.push(Object(dict));
+        }
+        void newObject(int n) {
+            ClassObject* bt = cxt.getClassDef(a[n]);
+            if (bt == nullptr) {
+                cout<<"Can't instantiate non-existant type: "<<atoms.nameOf(a[n])<<endl;
+                sf.push(Object());
+                return;
+            }
+            ClassObject* nobj = heap.make<ClassObject>();
+            nobj->typeName = bt->typeName;
+            for (auto t : bt->fields) {
+                TRACE(TRACE_INTERPRETER, atoms.nameOf(a[n]) << " inherits " << atoms.nameOf(t.first));
+                nobj->fields[t.first] = Object();
+            }
+            nobj->instantiated = true;
+            sf.push(Object(nobj));
+        }
+        void defineClass(int n) {
+            ClassObject* t = heap.make<ClassObject>();
+            t->typeName = a[n];
+            t->instantiated = false;
+            for (int i = 0; i < c[n]; i++)
+                t->setMember(lists[b[n] + i], Object());
+            cxt.addClassDef(t->getTypeAtom(), t);
+            cout<<"'"<<t->getTypeName()<<"' defined."<<endl;
+        }
+        __attribute__((noinline)) void loop(int n) {
+            loopDepth++;
+            eval(a[n]);
+            while (sf.pop().boolval()) {
+                eval(b[n]);
+                if (completion == CONTINUE)
+                    completion = NORMAL;
+                if (completion == BREAK) {
+                    completion = NORMAL;
+                    break;
+                }
+                if (completion != NORMAL)
+                    break;
+                eval(a[n]);
+            }
+            loopDepth--;
+        }
+        __attribute__((noinline)) void statements(int n) {
+            for (int i = 0; i < b[n]; i++) {
+                heap.safepoint();
+                eval(lists[a[n] + i]);
+                if (completion != NORMAL)
+                    return;
+            }
+        }
+        __attribute__((noinline)) void block(int n) {
+            cxt.openScope(heap.make<Scope>(cxt.getStack(), cxt.getStack(), b[n]));
+            eval(a[n]);
+            cxt.closeScope();
+        }
+        __attribute__((noinline)) void assign(int n) {
+            eval(a[n]);
+            Object rhs = assignOp(op[n], cxt.getAt(b[n], c[n]), sf.pop());
+            cxt.putAt(b[n], rhs, c[n]);
+            sf.push(rhs);
+        }
+        __attribute__((noinline)) void incDec(int n) {
+            eval(a[n]);
+            Object v = increment(sf.pop(), op[n] == TK_INCREMENT ? 1:-1);
+            sf.push(v);
+            cxt.putAt(b[n], v, c[n]);
+        }
+        __attribute__((noinline)) void print(int n) {
+            eval(a[n]);
+            sf.pop().print();
+        }
+        __attribute__((noinline)) void define(int n) {
+            if (b[n] >= 0)
+                cxt.putAt(b[n], Object(), c[n]);
+            eval(a[n]);
+            sf.pop();
+        }
+        __attribute__((noinline)) void branch(int n) {
+            eval(a[n]);
+            if (!sf.empty() && sf.pop().boolval()) {
+                eval(b[n]);
+            } else if (c[n] >= 0) {
+                eval(c[n]);
+            }
+        }
+        __attribute__((noinline)) void negate(int n) {
+            eval(a[n]);
+            sf.push(neg(sf.pop()));
+        }
+        //literals, variables and lambdas, everything that's a single push
+        __attribute__((noinline)) void value(int n) {
+            switch (kind[n]) {
+                case FL_INTEGER: sf.push(Object(tree->integers[a[n]])); break;
+                case FL_NUMBER:  sf.push(Object(tree->numbers[a[n]])); break;
+                case FL_STRING:  sf.push(Object(internedString(a[n]))); break;
+                case FL_TRUE:    sf.push(Object(true)); break;
+                case FL_FALSE:   sf.push(Object(false)); break;
+                case FL_NIL:     sf.push(cxt.getNil()); break;
+                case FL_LOAD:    sf.push(cxt.getAt(a[n], b[n])); break;
+                case FL_LAMBDA:  sf.push(Object(makeFunction(a[n]))); break;
+                case FL_FUNC_DEF: cxt.putAt(b[n], Object(makeFunction(a[n])), c[n]); break;
+                default:
+                    sf.push(Object());
+                    break;
+            }
+        }
+        //Every nested expression and statement recurses through here, so
+        //each case that needs a value of its own calls out to keep the
+        //frame small, deep recursion would overflow the stack otherwise
+        void eval(int n) {
+            switch (kind[n]) {
+                case FL_STMTS:
+                    statements(n);
+                    break;
+                case FL_BLOCK:
+                    block(n);
+                    break;
+                case FL_EXPR_STMT:
+                    eval(a[n]);
+                    sf.pop();
+                    break;
+                case FL_PRINT:
+                    print(n);
+                    break;
+                case FL_RETURN:
+                    eval(a[n]);
+                    if (completion == NORMAL)
+                        completion = RETURN;
+                    break;
+                case FL_LET:
+                    define(n);
+                    break;
+                case FL_WHILE:
+                    loop(n);
+                    break;
+                case FL_IF:
+                    branch(n);
+                    break;
+                case FL_BREAK:
+                    if (loopDepth > 0) completion = BREAK;
+                    break;
+                case FL_CONTINUE:
+                    if (loopDepth > 0) completion = CONTINUE;
+                    break;
+                case FL_CLASS_DEF:
+                    defineClass(n);
+                    break;
+                case FL_ASSIGN:
+                    assign(n);
+                    break;
+                case FL_SET_INDEX:
+                    setIndex(n);
+                    break;
+                case FL_SET_FIELD:
+                    setField(n);
+                    break;
+                case FL_BINARY:
+                    binary(n);
+                    break;
+                case FL_NEG:
+                    negate(n);
+                    break;
+                case FL_INCDEC:
+                    incDec(n);
+                    break;
+                case FL_CALL: case FL_TAIL_CALL:
+                    call(n);
+                    break;
+                case FL_INDEX:
+                    index(n);
+                    break;
+                case FL_FIELD:
+                    field(n);
+                    break;
+                case FL_ARRAY:
+                    makeArray(n);
+                    break;
+                case FL_DICT:
+                    makeDict(n);
+                    break;
+                case FL_EXPRS:
+                    for (int i = 0; i < b[n]; i++)
+                        eval(lists[a[n] + i]);
+                    break;
+                case FL_LISTOP:
+                    listOp(n);
+                    break;
+                case FL_NEW:
+                    newObject(n);
+                    break;
+                default:
+                    value(n);
+                    break;
+            }
+        }
+    public:
+        FlatEvaluator() : completion(NORMAL), tailEnv(nullptr), loopDepth(0), tree(nullptr) {
+            heap.addRoots(this);
+        }
+        ~FlatEvaluator() {
+            heap.removeRoots(this);
+        }
+        //a return at the top level ends the program it's in, not the session
+        void execute(FlatTree* program, int root) {
+            attach(program);
+            completion = NORMAL;
+            loopDepth = 0;
+            eval(root);
+            completion = NORMAL;
+        }
+        void markRoots(Heap& heap) {
+            cxt.markRoots(heap);
+            heap.mark(tailEnv);
+            for (int i = 0; i < sf.size(); i++)
+                heap.mark(sf.get(i));
+        }
+};
+
+#endif
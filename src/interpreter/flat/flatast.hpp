@@ -0,0 +1,132 @@
+#ifndef flatast_hpp
+#define flatast_hpp
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "../../parse/ast.hpp"
+using namespace std;
+
+//operands are indexes into the tree's columns: a node, a run of the
+//list column given as start and count, a slot and scope depth, an atom
+//or a number. -1 stands for an absent node.
+enum FlatKind : uint8_t {
+    FL_STMTS,       // a: list start, b: count
+    FL_BLOCK,       // a: statements, b: frame size
+    FL_EXPR_STMT,   // a: expression
+    FL_PRINT,       // a: expression
+    FL_RETURN,      // a: expression
+    FL_LET,         // a: expression, b: slot or -1, c: depth
+    FL_WHILE,       // a: predicate, b: body
+    FL_IF,          // a: predicate, b: true path, c: false path or -1
+    FL_FUNC_DEF,    // a: function record, b: slot, c: depth
+    FL_BREAK,
+    FL_CONTINUE,
+    FL_CLASS_DEF,   // a: type name atom, b: list start of field atoms, c: count
+    FL_INTEGER,     // a: integers index
+    FL_NUMBER,      // a: numbers index
+    FL_STRING,      // a: atom
+    FL_TRUE,
+    FL_FALSE,
+    FL_NIL,
+    FL_LOAD,        // a: slot, b: depth
+    FL_ASSIGN,      // op: assignment operator, a: value, b: slot, c: depth
+    FL_SET_INDEX,   // op: assignment operator, a: container, b: index, c: value
+    FL_SET_FIELD,   // op: assignment operator, a: container, b: field atom, c: value
+    FL_BINARY,      // op: operator, a: lhs, b: rhs
+    FL_NEG,         // a: operand
+    FL_INCDEC,      // op: ++ or --, a: operand, b: slot, c: depth
+    FL_CALL,        // a: callee, b: argument list start, c: count
+    FL_TAIL_CALL,   // a: callee, b: argument list start, c: count
+    FL_INDEX,       // a: container, b: index
+    FL_FIELD,       // a: container, b: field atom
+    FL_ARRAY,       // a: list start, b: count
+    FL_DICT,        // a: list start, b: count, c: 1 for an ordered map. keys and values alternate
+    FL_EXPRS,       // a: list start, b: count
+    FL_LISTOP,      // op: list operator, a: list, b: argument or -1
+    FL_LAMBDA,      // a: function record
+    FL_NEW,         // a: type name atom
+    FL_NOTHING
+};
+
+const char* flatKindNames[] = {
+    "stmts", "block", "expr_stmt", "print", "return", "let", "while", "if",
+    "func_def", "break", "continue", "class_def", "integer", "number", "string",
+    "true", "false", "nil", "load", "assign", "set_index", "set_field",
+    "binary", "neg", "incdec", "call", "tail_call", "index", "field",
+    "array", "dict", "exprs", "listop", "lambda", "new", "nothing"
+};
+
+//what a closure needs to run: its body and where its parameters go. The
+//pointer tree is kept for printing functions and for their names.
+struct FlatFunction {
+    IdExpr* name;
+    StatementList* params;
+    StatementList* astBody;
+    int body;
+    int paramStart;
+    int paramCount;
+    int frameSize;
+};
+
+//A resolved program lowered into parallel columns, one entry per node.
+//Nodes refer to each other by index so a walk over them stays inside a
+//handful of flat arrays instead of chasing pointers across the heap.
+//Trees only grow, the REPL keeps appending each line to the same one.
+class FlatTree {
+    public:
+        vector<uint8_t> kind;
+        vector<uint8_t> op;
+        vector<int> a;
+        vector<int> b;
+        vector<int> c;
+        vector<int> lists;
+        vector<int64_t> integers;
+        vector<double> numbers;
+        vector<FlatFunction> functions;
+        int add(FlatKind k, int x = 0, int y = 0, int z = 0, TKSymbol sym = TK_EOI) {
+            kind.push_back(k);
+            op.push_back(sym);
+            a.push_back(x);
+            b.push_back(y);
+            c.push_back(z);
+            return kind.size() - 1;
+        }
+        //copies a run of operands into the list column, returns its start
+        int addList(vector<int>& items) {
+            int start = lists.size();
+            lists.insert(lists.end(), items.begin(), items.end());
+            return start;
+        }
+        int addInteger(int64_t value) {
+            integers.push_back(value);
+            return integers.size() - 1;
+        }
+        int addNumber(double value) {
+            numbers.push_back(value);
+            return numbers.size() - 1;
+        }
+        int size() {
+            return kind.size();
+        }
+        void dump(int from = 0) {
+            for (int i = from; i < size(); i++) {
+                cout<<i<<": "<<flatKindNames[kind[i]];
+                if (op[i] != TK_EOI)
+                    cout<<" "<<tokenSpelling((TKSymbol)op[i]);
+                switch (kind[i]) {
+                    case FL_INTEGER: cout<<" "<<integers[a[i]]; break;
+                    case FL_NUMBER: cout<<" "<<numbers[a[i]]; break;
+                    case FL_STRING: case FL_NEW: cout<<" "<<atoms.nameOf(a[i]); break;
+                    case FL_FIELD: case FL_SET_FIELD: cout<<" "<<a[i]<<" ."<<atoms.nameOf(b[i]); break;
+                    case FL_CLASS_DEF: cout<<" "<<atoms.nameOf(a[i]); break;
+                    default:
+                        cout<<" "<<a[i]<<", "<<b[i]<<", "<<c[i];
+                        break;
+                }
+                cout<<endl;
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef flatten_hpp
+#define flatten_hpp
+#include <iostream>
+#include "../../parse/ast.hpp"
+#include "flatast.hpp"
+using namespace std;
+
+//Lowers a resolved AST into a FlatTree. Runs after ScopeResolver, slots,
+//depths and tail calls are copied out of the tokens as they stand, and
+//number literals are decoded once here rather than on every evaluation.
+class Flattener : public Visitor {
+    private:
+        FlatTree* tree;
+        int result;
+        int lower(SyntaxNode* node) {
+            if (node == nullptr)
+                return -1;
+            node->accept(this);
+            return result;
+        }
+        template <class T>
+        int lowerList(NodeArray<T>& nodes, int& count) {
+            vector<int> items;
+            for (auto node : nodes)
+                items.push_back(lower(node));
+            count = items.size();
+            return tree->addList(items);
+        }
+        int lowerFunction(IdExpr* name, StatementList* params, StatementList* body, int frameSize) {
+            FlatFunction fn;
+            fn.name = name;
+            fn.params = params;
+            fn.astBody = body;
+            fn.frameSize = frameSize;
+            vector<int> slots;
+            for (auto param : params->getList())
+                slots.push_back(((LetStmt*)param)->getExpression()->getToken().slotIndex());
+            fn.paramStart = tree->addList(slots);
+            fn.paramCount = slots.size();
+            fn.body = lower(body);
+            tree->functions.push_back(fn);
+            return tree->functions.size() - 1;
+        }
+    public:
+        Flattener() : tree(nullptr), result(-1) { }
+        //appends the program to the tree, returns the index of its root
+        int flatten(StatementList* program, FlatTree* into) {
+            tree = into;
+            return lower(program);
+        }
+        void visit(StatementList* stmts) {
+            int count;
+            int start = lowerList(stmts->getList(), count);
+            result = tree->add(FL_STMTS, start, count);
+        }
+        void visit(BlockStmt* stmt) {
+            int stmts = lower(stmt->getStatements());
+            result = tree->add(FL_BLOCK, stmts, stmt->getFrameSize());
+        }
+        void visit(ExprStmt* stmt) {
+            result = tree->add(FL_EXPR_STMT, lower(stmt->getExpression()));
+        }
+        void visit(ReturnStmt* stmt) {
+            result = tree->add(FL_RETURN, lower(stmt->getExpression()));
+        }
+        void visit(LoopControlStmt* stmt) {
+            result = tree->add(stmt->getToken().getSymbol() == TK_BREAK ? FL_BREAK:FL_CONTINUE);
+        }
+        void visit(PrintStmt* stmt) {
+            result = tree->add(FL_PRINT, lower(stmt->getExpr()));
+        }
+        void visit(LetStmt* stmt) {
+            Token& tk = stmt->getExpression()->getToken();
+            int expr = lower(stmt->getExpression());
+            if (tk.getSymbol() == TK_ID) {
+                result = tree->add(FL_LET, expr, tk.slotIndex(), tk.scopeLevel());
+            } else {
+                result = tree->add(FL_LET, expr, -1, 0);
+            }
+        }
+        void visit(WhileStmt* stmt) {
+            int pred = lower(stmt->getPredicate());
+            int body = lower(stmt->getBody());
+            result = tree->add(FL_WHILE, pred, body);
+        }
+        void visit(IfStmt* stmt) {
+            int pred = lower(stmt->getPredicate());
+            int truePath = lower(stmt->getTruePath());
+            int falsePath = lower(stmt->getFalsePath());
+            result = tree->add(FL_IF, pred, truePath, falsePath);
+        }
+        void visit(FuncDefStmt* stmt) {
+            int fn = lowerFunction(stmt->getName(), stmt->getParams(), stmt->getBody(), stmt->getFrameSize());
+            Token& tk = stmt->getName()->getToken();
+            result = tree->add(FL_FUNC_DEF, fn, tk.slotIndex(), tk.scopeLevel());
+        }
+        void visit(ObjectDefStmt* stmt) {
+            vector<int> fields;
+            for (auto q : stmt->getBody()->getList())
+                fields.push_back(((LetStmt*)q)->getExpression()->getToken().atomId());
+            int start = tree->addList(fields);
+            result = tree->add(FL_CLASS_DEF, stmt->getName()->getToken().atomId(), start, fields.size());
+        }
+        void visit(ExpressionList* exprs) {
+            int count;
+            int start = lowerList(exprs->getExpressions(), count);
+            result = tree->add(FL_EXPRS, start, count);
+        }
+        void visit(UnaryOpExpr* expr) {
+            TKSymbol sym = expr->getToken().getSymbol();
+            int operand = lower(expr->getExpr());
+            if (sym == TK_SUB) {
+                result = tree->add(FL_NEG, operand);
+            } else {
+                Token& tk = expr->getExpr()->getToken();
+                result = tree->add(FL_INCDEC, operand, tk.slotIndex(), tk.scopeLevel(), sym);
+            }
+        }
+        void visit(BinaryOpExpr* expr) {
+            TKSymbol sym = expr->getToken().getSymbol();
+            if (sym != TK_ASSIGN && sym != TK_ASSIGN_SUM && sym != TK_ASSIGN_DIFF) {
+                int lhs = lower(expr->getLeft());
+                int rhs = lower(expr->getRight());
+                result = tree->add(FL_BINARY, lhs, rhs, 0, sym);
+                return;
+            }
+            if (SubscriptExpr* ss = dynamic_cast<SubscriptExpr*>(expr->getLeft())) {
+                int container = lower(ss->getName());
+                if (ss->getToken().getSymbol() == TK_PERIOD) {
+                    int value = lower(expr->getRight());
+                    result = tree->add(FL_SET_FIELD, container, ss->getSubsript()->getToken().atomId(), value, sym);
+                } else {
+                    int index = lower(ss->getSubsript());
+                    int value = lower(expr->getRight());
+                    result = tree->add(FL_SET_INDEX, container, index, value, sym);
+                }
+                return;
+            }
+            Token& tk = expr->getLeft()->getToken();
+            result = tree->add(FL_ASSIGN, lower(expr->getRight()), tk.slotIndex(), tk.scopeLevel(), sym);
+        }
+        void visit(ConstExpr* expr) {
+            Token& tk = expr->getToken();
+            int64_t value;
+            switch (tk.getSymbol()) {
+                case TK_INTEGER:
+                    if (integerLiteral(tk.getString(), value)) {
+                        result = tree->add(FL_INTEGER, tree->addInteger(value));
+                        break;
+                    }
+                    //too wide for 64 bits, it's read as a double
+                    [[fallthrough]];
+                case TK_NUMBER: result = tree->add(FL_NUMBER, tree->addNumber(stod(tk.getString()))); break;
+                case TK_STRING: result = tree->add(FL_STRING, tk.atomId()); break;
+                case TK_TRUE:   result = tree->add(FL_TRUE); break;
+                case TK_FALSE:  result = tree->add(FL_FALSE); break;
+                case TK_NULL:   result = tree->add(FL_NIL); break;
+                default:
+                    result = tree->add(FL_NOTHING);
+                    break;
+            }
+        }
+        void visit(IdExpr* expr) {
+            result = tree->add(FL_LOAD, expr->getToken().slotIndex(), expr->getToken().scopeLevel());
+        }
+        void visit(FunctionCallExpr* expr) {
+            int callee = lower(expr->getName());
+            int count;
+            int start = lowerList(expr->getArguments()->getExpressions(), count);
+            result = tree->add(expr->isTailCall() ? FL_TAIL_CALL:FL_CALL, callee, start, count);
+        }
+        void visit(SubscriptExpr* expr) {
+            int container = lower(expr->getName());
+            if (expr->getToken().getSymbol() == TK_PERIOD) {
+                result = tree->add(FL_FIELD, container, expr->getSubsript()->getToken().atomId());
+            } else {
+                result = tree->add(FL_INDEX, container, lower(expr->getSubsript()));
+            }
+        }
+        void visit(ArrayConstructorExpr* expr) {
+            int count;
+            int start = lowerList(expr->getExpressions(), count);
+            TKSymbol kind = expr->getToken().getSymbol();
+            if (kind == TK_LC || kind == TK_ORDERED)
+                result = tree->add(FL_DICT, start, count, kind == TK_ORDERED);
+            else
+                result = tree->add(FL_ARRAY, start, count);
+        }
+        void visit(ListOpExpr* expr) {
+            int list = lower(expr->getList());
+            int arg = lower(expr->getExpr());
+            result = tree->add(FL_LISTOP, list, arg, 0, expr->getToken().getSymbol());
+        }
+        void visit(LambdaExpr* expr) {
+            int fn = lowerFunction(expr->getName(), expr->getParams(), expr->getBody(), expr->getFrameSize());
+            result = tree->add(FL_LAMBDA, fn);
+        }
+        void visit(ObjectConstructorExpr* expr) {
+            result = tree->add(FL_NEW, expr->getName()->getToken().atomId());
+        }
+};
+
+#endif
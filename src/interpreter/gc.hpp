@@ -0,0 +1,165 @@
+#ifndef gc_hpp
+#define gc_hpp
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+using namespace std;
+
+struct Object;
+class Heap;
+
+//Every heap allocated value the engines hand out derives from GCObject
+//so the collector can find it again: allocations are threaded onto an
+//intrusive list and swept when the mark phase doesn't reach them.
+struct GCObject {
+    bool marked;
+    bool pinned;
+    GCObject* next;
+    GCObject() : marked(false), pinned(false), next(nullptr) { }
+    virtual ~GCObject() { }
+    //marks everything this object references
+    virtual void trace(Heap& heap) { }
+    //approximate footprint, used to decide when to collect
+    virtual size_t footprint() = 0;
+};
+
+//anything holding references the collector can't otherwise see
+class RootSet {
+    public:
+        virtual void markRoots(Heap& heap) = 0;
+};
+
+struct GCStats {
+    int collections;
+    size_t objectsFreed;
+    size_t bytesFreed;
+    size_t peakHeap;
+    double totalPause;
+    double maxPause;
+    GCStats() : collections(0), objectsFreed(0), bytesFreed(0), peakHeap(0), totalPause(0), maxPause(0) { }
+};
+
+//Stop the world mark and sweep collector. Collections are only started
+//from safepoints in the engines, where every live value is reachable
+//from a registered RootSet, never from inside an allocation.
+class Heap {
+    private:
+        GCObject* objects;
+        int objectCount;
+        size_t allocated;
+        size_t threshold;
+        size_t minThreshold;
+        double growthFactor;
+        vector<RootSet*> roots;
+        vector<GCObject*> gray;
+        GCStats stats;
+        void track(GCObject* obj) {
+            obj->next = objects;
+            objects = obj;
+            objectCount++;
+            allocated += obj->footprint();
+            stats.peakHeap = max(stats.peakHeap, allocated);
+        }
+        void drain() {
+            while (!gray.empty()) {
+                GCObject* obj = gray.back();
+                gray.pop_back();
+                obj->trace(*this);
+            }
+        }
+        void sweep() {
+            GCObject** link = &objects;
+            size_t live = 0;
+            while (*link != nullptr) {
+                GCObject* obj = *link;
+                if (obj->marked || obj->pinned) {
+                    obj->marked = false;
+                    live += obj->footprint();
+                    link = &obj->next;
+                } else {
+                    *link = obj->next;
+                    stats.objectsFreed++;
+                    objectCount--;
+                    delete obj;
+                }
+            }
+            stats.bytesFreed += allocated > live ? allocated - live:0;
+            allocated = live;
+        }
+    public:
+        Heap(size_t initialThreshold = 1 << 20, double growth = 2.0) {
+            objects = nullptr;
+            objectCount = 0;
+            allocated = 0;
+            configure(initialThreshold, growth);
+        }
+        void configure(size_t initialThreshold, double growth) {
+            minThreshold = initialThreshold;
+            threshold = initialThreshold;
+            growthFactor = growth < 1.1 ? 1.1:growth;
+        }
+        template <class T, class... Args>
+        T* make(Args&&... args) {
+            T* obj = new T(args...);
+            track(obj);
+            return obj;
+        }
+        //objects that grow after they're made report it here, otherwise
+        //what they add never counts toward the next collection. The
+        //sweep measures every survivor again so shrinking needs no report
+        void grew(size_t bytes) {
+            allocated += bytes;
+            stats.peakHeap = max(stats.peakHeap, allocated);
+        }
+        void addRoots(RootSet* rs) {
+            roots.push_back(rs);
+        }
+        void removeRoots(RootSet* rs) {
+            roots.erase(remove(roots.begin(), roots.end(), rs), roots.end());
+        }
+        void mark(GCObject* obj) {
+            if (obj == nullptr || obj->marked)
+                return;
+            obj->marked = true;
+            gray.push_back(obj);
+        }
+        void mark(Object& obj);
+        //pinned objects survive every collection, used for constants
+        //owned by code that outlives any one engine
+        void pin(Object& obj);
+        void safepoint() {
+            if (allocated >= threshold)
+                collect();
+        }
+        void collect() {
+            auto start = chrono::steady_clock::now();
+            for (RootSet* rs : roots) {
+                rs->markRoots(*this);
+                drain();
+            }
+            sweep();
+            threshold = max(minThreshold, (size_t)(allocated * growthFactor));
+            double pause = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            stats.collections++;
+            stats.totalPause += pause;
+            stats.maxPause = max(stats.maxPause, pause);
+        }
+        size_t heapSize() {
+            return allocated;
+        }
+        GCStats& getStats() {
+            return stats;
+        }
+        void printStats() {
+            cout<<"gc collections: "<<stats.collections<<endl;
+            cout<<"gc total pause: "<<stats.totalPause<<"ms (max "<<stats.maxPause<<"ms)"<<endl;
+            cout<<"gc freed:       "<<stats.objectsFreed<<" objects, "<<stats.bytesFreed/1024<<"kb"<<endl;
+            cout<<"heap size:      "<<allocated/1024<<"kb in "<<objectCount<<" objects (peak "<<stats.peakHeap/1024<<"kb)"<<endl;
+            cout<<"next gc at:     "<<threshold/1024<<"kb"<<endl;
+        }
+};
+
+Heap heap;
+
+#endif
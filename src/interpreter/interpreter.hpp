@@ -3,105 +3,240 @@
 #include <cmath>
 #include "resolvescope.hpp"
 #include "context.hpp"
-#include "re/re_compiler.hpp"
-#include "re/subset_match.hpp"
+#include "re/re_cache.hpp"
 
-class ReturnStmtException : public std::exception {
-    virtual const char* what() const throw() {
-        return "return stmt";
-    }
+//how the last statement finished. Anything but NORMAL skips the rest of
+//the enclosing statement lists until a loop or function call consumes it.
+//TAILCALL is a return whose value is still to be computed by tailEnv.
+enum Completion {
+    NORMAL, RETURN, BREAK, CONTINUE, TAILCALL
+};
+
+//A BinaryOpExpr starts out UNSEEN. If its first evaluation sees two
+//numbers it's rewritten to the number-number version of its operator,
+//which only checks that both operands are still numbers before doing the
+//arithmetic. Any other operands, then or later, leave it GENERIC for good
+//so a polymorphic node doesn't flip back and forth. A specialized node
+//also records whether each operand is a variable or a pooled literal,
+//those are read in place instead of being visited and pushed.
+//Assignments are told apart by their target once rather than every time.
+enum Specialization {
+    SPEC_UNSEEN, SPEC_GENERIC,
+    SPEC_ASSIGN_VAR, SPEC_ASSIGN_SUBSCRIPT,
+    SPEC_ADD, SPEC_SUB, SPEC_MUL, SPEC_DIV, SPEC_MOD,
+    SPEC_LT, SPEC_GT, SPEC_LTE, SPEC_GTE, SPEC_EQ, SPEC_NEQ
 };
 
+enum OperandShape {
+    OPERAND_ANY, OPERAND_VAR, OPERAND_CONST
+};
+
+const int SPEC_MASK = 0xff;
+const int LEFT_SHAPE = 8;
+const int RIGHT_SHAPE = 10;
+
+OperandShape operandShape(ExprNode* expr) {
+    if (dynamic_cast<IdExpr*>(expr))
+        return OPERAND_VAR;
+    ConstExpr* ce = dynamic_cast<ConstExpr*>(expr);
+    if (ce && ce->getConstant() >= 0)
+        return OPERAND_CONST;
+    return OPERAND_ANY;
+}
+
+Specialization numericSpecialization(TKSymbol op) {
+    switch (op) {
+        case TK_ADD: return SPEC_ADD;
+        case TK_SUB: return SPEC_SUB;
+        case TK_MUL: return SPEC_MUL;
+        case TK_DIV: return SPEC_DIV;
+        case TK_MOD: return SPEC_MOD;
+        case TK_LT:  return SPEC_LT;
+        case TK_GT:  return SPEC_GT;
+        case TK_LTE: return SPEC_LTE;
+        case TK_GTE: return SPEC_GTE;
+        case TK_EQ:  return SPEC_EQ;
+        case TK_NEQ: return SPEC_NEQ;
+        default:
+            break;
+    }
+    return SPEC_GENERIC;
+}
+
 
 //def cd(let k) { if (k < 10) { println k; k := k + 1; cd(k); } else { println "dine"; } }; cd(5);
 
-class Interpreter : public Visitor {
+class Interpreter : public Visitor, public RootSet {
     private:
         Context cxt;
         InspectableStack<Object> sf;
-        void handleSubscriptAssignment(BinaryOpExpr* expr, Object rhs) {
-            auto x = dynamic_cast<SubscriptExpr*>(expr->getLeft());
+        ConstantPool* constants;
+        Completion completion;
+        Scope* tailEnv;
+        //loops open in the current function, break and continue outside of one are ignored
+        int loopDepth;
+        //the container, subscript and value stay on the stack until the
+        //assignment is done so a collection can't pull them out from under us
+        void handleSubscriptAssignment(BinaryOpExpr* expr) {
+            auto x = (SubscriptExpr*)expr->getLeft();
+            bool member = x->getToken().getSymbol() == TK_PERIOD;
             x->getName()->accept(this);
+            if (!member)
+                x->getSubsript()->accept(this);
+            expr->getRight()->accept(this);
+            Object rhs = sf.pop();
+            Object idx = member ? Object():sf.pop();
             Object m = sf.pop();
-            x->getSubsript()->accept(this);
-            if (m.type == ARRAY) {
-                int pos = sf.pop().numval;
-                switch (expr->getToken().getSymbol()) {
-                    case TK_ASSIGN: m.arr->at(pos) = rhs; break;
-                    case TK_ASSIGN_SUM: m.arr->at(pos) = add(m.arr->at(pos), rhs); break;
-                    case TK_ASSIGN_DIFF: m.arr->at(pos) = sub(m.arr->at(pos), rhs); break;
-                }
-            } else if (m.type == OBJECT) {
-                ClassObject* co = m.clazz;
-                string name = x->getSubsript()->getToken().getString();
-                if (co->fields.find(name) == co->fields.end()) {
-                    cout<<name<<"? never heard of it for a  "<<co->getTypeName()<<endl;
+            if (m.type() == ARRAY) {
+                int64_t pos = idx.intval();
+                applyAssignment(expr, m.arr()->at(pos), rhs);
+                sf.push(m.arr()->at(pos));
+            } else if (m.type() == DICT) {
+                Object& value = m.dict()->at(idx);
+                applyAssignment(expr, value, rhs);
+                sf.push(value);
+            } else if (m.type() == ORDERED) {
+                Object& value = m.ordered()->at(idx);
+                applyAssignment(expr, value, rhs);
+                sf.push(value);
+            } else if (m.type() == OBJECT) {
+                ClassObject* co = m.clazz();
+                int name = x->getSubsript()->getToken().atomId();
+                auto field = co->fields.find(name);
+                if (field == co->fields.end()) {
+                    cout<<x->getSubsript()->getToken().getString()<<"? never heard of it for a  "<<co->getTypeName()<<endl;
+                    sf.push(Object());
                     return;
                 }
-                co->fields[name] = rhs;
+                applyAssignment(expr, field->second, rhs);
+                sf.push(field->second);
+            } else {
+                sf.push(Object());
             }
         }
-        void handleAssignment(BinaryOpExpr* expr, Object rhs) {
-            string name = expr->getLeft()->getToken().getString();
-            if (SubscriptExpr* ss = dynamic_cast<SubscriptExpr*>(expr->getLeft())) {
-                handleSubscriptAssignment(expr, rhs);
-            } else {
-                //cout<<"Assigning: "<<rhs.toString()<<" to "<<name<<" at depth: "<<expr->getLeft()->getToken().scopeLevel()<<endl;
-                Object lhs = cxt.getAt(name, expr->getLeft()->getToken().scopeLevel());
-                switch (expr->getToken().getSymbol()) {
-                    case TK_ASSIGN: break;
-                    case TK_ASSIGN_SUM: rhs = add(lhs, rhs); break;
-                    case TK_ASSIGN_DIFF: rhs = sub(lhs, rhs); break;
-                }
-                cxt.putAt(name, rhs, expr->getLeft()->getToken().scopeLevel());
-                
+        void applyAssignment(BinaryOpExpr* expr, Object& lhs, Object rhs) {
+            switch (expr->getToken().getSymbol()) {
+                case TK_ASSIGN: lhs = rhs; break;
+                case TK_ASSIGN_SUM: lhs = add(lhs, rhs); break;
+                case TK_ASSIGN_DIFF: lhs = sub(lhs, rhs); break;
+                default: break;
             }
         }
+        void handleAssignment(BinaryOpExpr* expr) {
+            if (expr->getSpecialization() == SPEC_UNSEEN) {
+                bool subscript = dynamic_cast<SubscriptExpr*>(expr->getLeft()) != nullptr;
+                expr->setSpecialization(subscript ? SPEC_ASSIGN_SUBSCRIPT:SPEC_ASSIGN_VAR);
+            }
+            if (expr->getSpecialization() == SPEC_ASSIGN_SUBSCRIPT) {
+                handleSubscriptAssignment(expr);
+                return;
+            }
+            expr->getRight()->accept(this);
+            Object rhs = sf.pop();
+            Token& tk = expr->getLeft()->getToken();
+            Object lhs = cxt.getAt(tk.slotIndex(), tk.scopeLevel());
+            switch (expr->getToken().getSymbol()) {
+                case TK_ASSIGN: break;
+                case TK_ASSIGN_SUM: rhs = add(lhs, rhs); break;
+                case TK_ASSIGN_DIFF: rhs = sub(lhs, rhs); break;
+                default: break;
+            }
+            cxt.putAt(tk.slotIndex(), rhs, tk.scopeLevel());
+            sf.push(rhs);
+        }
         void handleRegExMatch(Object txt, Object pat) {
-            RECompiler cmp;
-            REParser prs;
             string text = txt.toString();
             text = text.substr(1, text.length()-2);
             string pattern = pat.toString();
             pattern = pattern.substr(1, pattern.length()-2);
-            cout<<"Looking for "<<pattern<<" in "<<text<<endl;
-            NFA nfa = cmp.compile(prs.parse(pattern));
-            sf.push(Object(match(nfa, text)));
-        }
-        Scope* evaluateArguments(Function* func, list<ExprNode*> args) {
-            Scope* scope = new Scope(func->closure, cxt.getStack());
-            list<StmtNode*> params = func->getParams()->getList();
-            auto param = params.begin();
-            auto arg = args.begin();
-            while (param != params.end() && arg != args.end()) {
-                (*arg)->accept(this);
-                Object val = sf.pop();
-                string name = ((IdExpr*)((LetStmt*)(*param))->getExpression())->getToken().getString();
-                //cout<<"Binding "<<val.toString()<<" to "<<name<<endl;
-                scope->bindings[name] = val;
-                param++; arg++;
-            }
-            if (param != params.end() || arg != args.end()) {
+            sf.push(Object(matchRegEx(pattern, text)));
+        }
+        //arguments are evaluated onto the stack before the frame exists,
+        //then moved into it.
+        Scope* evaluateArguments(Function* func, NodeArray<ExprNode*>& args) {
+            int base = sf.size();
+            for (auto arg : args) {
+                arg->accept(this);
+            }
+            Scope* scope = heap.make<Scope>(func->closure, cxt.getStack(), func->frameSize);
+            NodeArray<StmtNode*>& params = func->getParams()->getList();
+            if (params.size() != args.size()) {
                 cout<<"Error: function call has mismatched arguments."<<endl;
             }
+            int i = base;
+            for (auto param : params) {
+                if (i == sf.size())
+                    break;
+                int slot = ((LetStmt*)param)->getExpression()->getToken().slotIndex();
+                scope->slots[slot] = sf.get(i++);
+            }
+            while (sf.size() > base) sf.pop();
             return scope;
         }
+        //a trailing expression statement is the function's value
+        void evaluateBody(StatementList* body) {
+            auto& stmts = body->getList();
+            ExprStmt* last = stmts.empty() ? nullptr:dynamic_cast<ExprStmt*>(stmts.back());
+            for (auto stmt : stmts) {
+                heap.safepoint();
+                if (stmt == last) {
+                    last->getExpression()->accept(this);
+                } else {
+                    stmt->accept(this);
+                    if (completion != NORMAL)
+                        break;
+                }
+            }
+        }
+        //tail calls don't recurse, they leave their callee on the stack and
+        //its frame in tailEnv, and the call is run here in place of this one
         void applyFunction(Function* func, Scope* env) {
-            cxt.openScope(env);
-            try {
-                func->getBody()->accept(this);
-            } catch (ReturnStmtException rse) {
-
+            Scope* caller = cxt.getStack();
+            int base = sf.size();
+            int loops = loopDepth;
+            bool replaced = false;
+            for (;;) {
+                loopDepth = 0;
+                env->control = caller;
+                cxt.openScope(env);
+                evaluateBody(func->getBody());
+                if (completion != TAILCALL)
+                    break;
+                completion = NORMAL;
+                Object callee = sf.pop();
+                while (sf.size() > base) sf.pop();
+                //the callee has to stay reachable while it runs
+                if (replaced) {
+                    sf.top() = callee;
+                } else {
+                    sf.push(callee);
+                    base++;
+                    replaced = true;
+                }
+                func = callee.func();
+                env = tailEnv;
+                tailEnv = nullptr;
+            }
+            completion = NORMAL;
+            loopDepth = loops;
+            cxt.openScope(caller);
+            if (sf.size() == base) {
+                sf.push(Object());
+            }
+            if (replaced) {
+                Object result = sf.pop();
+                sf.pop();
+                sf.push(result);
             }
-            cxt.closeScope();
         }
         void doPrimitive(BinaryOpExpr* expr, Object& lhs, Object& rhs) {
             switch (expr->getToken().getSymbol()) {
                 case TK_ADD: sf.push(add(lhs, rhs));break;
                 case TK_SUB: sf.push(sub(lhs, rhs)); break;
-                case TK_MUL: sf.push(Object(lhs.numval * rhs.numval));break;
-                case TK_DIV: sf.push(Object(lhs.numval / rhs.numval)); break;
-                case TK_MOD: sf.push(Object(std::fmod(lhs.numval, rhs.numval))); break;
+                case TK_MUL: sf.push(mul(lhs, rhs));break;
+                case TK_DIV: sf.push(div(lhs, rhs)); break;
+                case TK_MOD: sf.push(mod(lhs, rhs)); break;
+                default: break;
             }
         }
         void doCompare(BinaryOpExpr* expr, Object& lhs, Object& rhs) {
@@ -113,12 +248,71 @@ class Interpreter : public Visitor {
                 case TK_EQ: sf.push(equ(lhs, rhs)); break;
                 case TK_NEQ: sf.push(neq(lhs, rhs)); break;
                 case TK_MATCHRE: handleRegExMatch(lhs, rhs); break;
+                default: break;
             }
         }
         void doLogicOp(BinaryOpExpr* expr, Object& lhs, Object& rhs) {
             switch (expr->getToken().getSymbol()) {
-                case TK_AND: sf.push(Object(lhs.boolval && rhs.boolval)); break;
-                case TK_OR: sf.push(Object(lhs.boolval || rhs.boolval)); break;
+                case TK_AND: sf.push(Object(lhs.boolval() && rhs.boolval())); break;
+                case TK_OR: sf.push(Object(lhs.boolval() || rhs.boolval())); break;
+                default: break;
+            }
+        }
+        void specialize(BinaryOpExpr* expr, Object& lhs, Object& rhs) {
+            Specialization spec = SPEC_GENERIC;
+            if (lhs.isNumber() && rhs.isNumber())
+                spec = numericSpecialization(expr->getToken().getSymbol());
+            if (spec == SPEC_GENERIC) {
+                expr->setSpecialization(SPEC_GENERIC);
+                return;
+            }
+            int left = operandShape(expr->getLeft()), right = operandShape(expr->getRight());
+            expr->setSpecialization(spec | (left << LEFT_SHAPE) | (right << RIGHT_SHAPE));
+        }
+        Object& operand(ExprNode* expr, int shape) {
+            if (shape == OPERAND_VAR) {
+                Token& tk = expr->getToken();
+                return cxt.getAt(tk.slotIndex(), tk.scopeLevel());
+            }
+            return constants->get(((ConstExpr*)expr)->getConstant());
+        }
+        void pushOperand(ExprNode* expr, int shape) {
+            if (shape == OPERAND_ANY) {
+                expr->accept(this);
+            } else {
+                sf.push(operand(expr, shape));
+            }
+        }
+        //the fast paths of a specialized node, both operands known to be integers
+        void applyInteger(int spec, int64_t lhs, int64_t rhs) {
+            switch (spec) {
+                case SPEC_ADD: sf.push(addInt(lhs, rhs)); break;
+                case SPEC_SUB: sf.push(subInt(lhs, rhs)); break;
+                case SPEC_MUL: sf.push(mulInt(lhs, rhs)); break;
+                case SPEC_DIV: sf.push(divInt(lhs, rhs)); break;
+                case SPEC_MOD: sf.push(modInt(lhs, rhs)); break;
+                case SPEC_LT:  sf.push(Object(lhs < rhs)); break;
+                case SPEC_GT:  sf.push(Object(lhs > rhs)); break;
+                case SPEC_LTE: sf.push(Object(lhs <= rhs)); break;
+                case SPEC_GTE: sf.push(Object(lhs >= rhs)); break;
+                case SPEC_EQ:  sf.push(Object(lhs == rhs)); break;
+                case SPEC_NEQ: sf.push(Object(lhs != rhs)); break;
+            }
+        }
+        //or numbers, at least one of them a double
+        void applyNumeric(int spec, double lhs, double rhs) {
+            switch (spec) {
+                case SPEC_ADD: sf.push(Object(lhs + rhs)); break;
+                case SPEC_SUB: sf.push(Object(lhs - rhs)); break;
+                case SPEC_MUL: sf.push(Object(lhs * rhs)); break;
+                case SPEC_DIV: sf.push(Object(lhs / rhs)); break;
+                case SPEC_MOD: sf.push(Object(std::fmod(lhs, rhs))); break;
+                case SPEC_LT:  sf.push(Object(lhs < rhs)); break;
+                case SPEC_GT:  sf.push(Object(lhs > rhs)); break;
+                case SPEC_LTE: sf.push(Object(lhs <= rhs)); break;
+                case SPEC_GTE: sf.push(Object(lhs >= rhs)); break;
+                case SPEC_EQ:  sf.push(Object(lhs == rhs)); break;
+                case SPEC_NEQ: sf.push(Object(lhs != rhs)); break;
             }
         }
         void applyBinaryOperator(BinaryOpExpr* expr, Object& lhs, Object& rhs) {
@@ -127,99 +321,109 @@ class Interpreter : public Visitor {
                 case TK_ADD: case TK_SUB: case TK_MUL: case TK_DIV: case TK_MOD:
                     doPrimitive(expr, lhs, rhs);
                     break;
-                case TK_ASSIGN_SUM: case TK_ASSIGN_DIFF: case TK_ASSIGN: 
-                    handleAssignment(expr, rhs);
-                     break;
                 case TK_MATCHRE: case TK_LT: case TK_GT:  
                 case TK_EQ: case TK_LTE: case TK_GTE: case TK_NEQ: 
                     doCompare(expr, lhs, rhs);
+                    break;
                 case TK_AND: case TK_OR:
                     doLogicOp(expr, lhs, rhs);
                     break;
                 default:
+                    sf.push(Object());
                     break;
             }
         }
-        void doPush(ListOpExpr* expr, Object& m) {
-            expr->getExpr()->accept(this);
-            m.arr->insert(m.arr->begin(), sf.pop());
-            sf.push(m);
+        //applies a function of one argument, leaving its value on the stack
+        void applyUnary(Function* func, Object arg) {
+            Scope* scope = heap.make<Scope>(func->closure, cxt.getStack(), func->frameSize);
+            NodeArray<StmtNode*>& params = func->getParams()->getList();
+            if (!params.empty()) {
+                int slot = ((LetStmt*)params.front())->getExpression()->getToken().slotIndex();
+                scope->slots[slot] = arg;
+            }
+            applyFunction(func, scope);
         }
-        void doPop(Object& m) {
-            Object t = m.arr->at(0);
-            m.arr->erase(m.arr->begin());
-            sf.push(t);
+        Object doPush(Object& m, Object& arg) {
+            m.arr()->push_front(arg);
+            return m;
         }
-        void doAppend(ListOpExpr* expr, Object& m) {
-            expr->getExpr()->accept(this);
-            m.arr->push_back(sf.pop());
-            sf.push(m);
+        Object doPop(Object& m) {
+            return m.arr()->pop_front();
         }
-        void doGet(ListOpExpr* expr, Object& m) {
-            expr->getExpr()->accept(this);
-            sf.push(m.arr->at(sf.pop().numval));
+        Object doAppend(Object& m, Object& arg) {
+            m.arr()->push_back(arg);
+            return m;
+        }
+        Object doGet(Object& m, Object& arg) {
+            return m.arr()->at(arg.intval());
         }
-        void doCdr(Object& m) {
-            vector<Object>* obj = new vector<Object>();
-            for (int i = 1; i < m.arr->size(); i++) {
-                obj->push_back(m.arr->at(i));
+        Object doCdr(Object& m) {
+            ArrayObject* obj = heap.make<ArrayObject>();
+            for (size_t i = 1; i < m.arr()->size(); i++) {
+                obj->push_back(m.arr()->at(i));
             }
-            sf.push(Object(obj));
+            return Object(obj);
         }
-        void doMap(ListOpExpr* expr, Object& m) {
-            expr->getExpr()->accept(this);
-            Object lmb = sf.pop();
-            if (lmb.type == FUNC) {
-                vector<Object>* res = new vector<Object>();
-                for (Object t : *(m.arr)) {
-                    Scope* scope = new Scope(lmb.func->closure, cxt.getStack());
-                    string name = lmb.func->getParams()->getList().front()->getToken().getString();
-                    //cout<<"Binding "<<t.toString()<<" to "<<name<<endl;
-                    scope->bindings[name] = t;
-                    applyFunction(lmb.func,scope);
-                    res->push_back(sf.pop());
-                } 
-                sf.push(Object(res));
-            } else {
+        //the result list rides on the stack while the function is applied
+        Object doMap(Object& m, Object& lmb) {
+            if (lmb.type() != FUNC) {
                 cout<<"Error: map expects a function argument"<<endl;
+                return Object();
             }
+            ArrayObject* res = heap.make<ArrayObject>();
+            sf.push(Object(res));
+            for (size_t i = 0; i < m.arr()->size(); i++) {
+                applyUnary(lmb.func(), m.arr()->at(i));
+                res->push_back(sf.pop());
+            }
+            return sf.pop();
         }
-        void doFilter(ListOpExpr* expr, Object& m) {
-            expr->getExpr()->accept(this);
-            Object lmb = sf.pop();
-            if (lmb.type == FUNC) {
-                vector<Object>* res = new vector<Object>();
-                for (Object t : *(m.arr)) {
-                    Scope* scope = new Scope(lmb.func->closure, cxt.getStack());
-                    string name = lmb.func->getParams()->getList().front()->getToken().getString();
-                    //cout<<"Binding "<<t.toString()<<" to "<<name<<endl;
-                    scope->bindings[name] = t;
-                    applyFunction(lmb.func, scope);
-                    if (sf.pop().boolval)
-                        res->push_back(t);
-                } 
-                sf.push(Object(res));
-            } else {
-                cout<<"Error: map expects a function argument"<<endl;
+        Object doFilter(Object& m, Object& lmb) {
+            if (lmb.type() != FUNC) {
+                cout<<"Error: filter expects a function argument"<<endl;
+                return Object();
+            }
+            ArrayObject* res = heap.make<ArrayObject>();
+            sf.push(Object(res));
+            for (size_t i = 0; i < m.arr()->size(); i++) {
+                applyUnary(lmb.func(), m.arr()->at(i));
+                if (sf.pop().boolval())
+                    res->push_back(m.arr()->at(i));
             }
+            return sf.pop();
         }
     public:
-        Interpreter() {
-
+        Interpreter(ConstantPool* pool) : constants(pool), completion(NORMAL), tailEnv(nullptr), loopDepth(0) {
+            heap.addRoots(this);
+        }
+        ~Interpreter() {
+            heap.removeRoots(this);
+        }
+        //a return at the top level ends the program it's in, not the session
+        void execute(StatementList* program) {
+            completion = NORMAL;
+            loopDepth = 0;
+            program->accept(this);
+            completion = NORMAL;
+        }
+        void markRoots(Heap& heap) {
+            cxt.markRoots(heap);
+            heap.mark(tailEnv);
+            for (int i = 0; i < sf.size(); i++)
+                heap.mark(sf.get(i));
         }
         void visit(LetStmt* stmt) {
             if (stmt->getExpression()->getToken().getSymbol() == TK_ID) {
-                string name = stmt->getExpression()->getToken().getString();
-                int depth = stmt->getExpression()->getToken().scopeLevel();
-                cxt.putAt(name, Object(), depth);
-                //cout<<"Added to symbol table: "<<name<<endl;
+                Token& tk = stmt->getExpression()->getToken();
+                cxt.putAt(tk.slotIndex(), Object(), tk.scopeLevel());
             }
             stmt->getExpression()->accept(this);
+            sf.pop();
         }
         void visit(IfStmt* stmt) {
             //cout<<"If Stmt"<<endl;
             stmt->getPredicate()->accept(this);
-            if (!sf.empty() && sf.pop().boolval) {
+            if (!sf.empty() && sf.pop().boolval()) {
                // cout<<"took True path"<<endl;
                 stmt->getTruePath()->accept(this);
             } else {
@@ -230,15 +434,28 @@ class Interpreter : public Visitor {
             }
         }
         void visit(WhileStmt* stmt) {
+            loopDepth++;
             stmt->getPredicate()->accept(this);
-            while (sf.pop().boolval) {
+            while (sf.pop().boolval()) {
                 stmt->getBody()->accept(this);
+                if (completion == CONTINUE)
+                    completion = NORMAL;
+                if (completion == BREAK) {
+                    completion = NORMAL;
+                    break;
+                }
+                if (completion != NORMAL)
+                    break;
                 stmt->getPredicate()->accept(this);
             }
+            loopDepth--;
         }
         void visit(StatementList* stmt) {
             for (auto stmt : stmt->getList()) {
+                heap.safepoint();
                 stmt->accept(this);
+                if (completion != NORMAL)
+                    return;
             }
         }
         void visit(PrintStmt* stmt) {
@@ -247,125 +464,240 @@ class Interpreter : public Visitor {
         }
         void visit(ExprStmt* stmt) {
             stmt->getExpression()->accept(this);
+            sf.pop();
         }
         void visit(ReturnStmt* stmt) {
             stmt->getExpression()->accept(this);
-            throw ReturnStmtException();
+            if (completion == NORMAL)
+                completion = RETURN;
+        }
+        void visit(LoopControlStmt* stmt) {
+            if (loopDepth == 0)
+                return;
+            completion = stmt->getToken().getSymbol() == TK_BREAK ? BREAK:CONTINUE;
         }
         void visit(FuncDefStmt* stmt) {
-            string name = stmt->getName()->getToken().getString();
-            int depth = stmt->getName()->getToken().scopeLevel();
-            Function* func = new Function();
+            Token& tk = stmt->getName()->getToken();
+            Function* func = heap.make<Function>();
             func->body = stmt->getBody();
             func->params = stmt->getParams();
             func->name = stmt->getName();
             func->closure = cxt.getStack();
-            cxt.putAt(name, Object(func), depth);
+            func->frameSize = stmt->getFrameSize();
+            cxt.putAt(tk.slotIndex(), Object(func), tk.scopeLevel());
         }
         void visit(LambdaExpr* expr) {
-            Function* func = new Function();
+            Function* func = heap.make<Function>();
             func->body = expr->getBody();
             func->params = expr->getParams();
-            func->name = new IdExpr(Token(TK_DEF, "Lambda"));
+            func->name = expr->getName();
             func->closure = cxt.getStack();
+            func->frameSize = expr->getFrameSize();
             sf.push(Object(func));
         }
         void visit(FunctionCallExpr* expr) {
             expr->getName()->accept(this);
-            auto func = sf.pop();
-            if (func.type != FUNC) {
+            Object func = sf.top();
+            if (func.type() != FUNC) {
                 cout<<"Error not a function"<<endl;
+                sf.pop();
+                sf.push(Object());
                 return;
             }
-            auto args = expr->getArguments()->getExpressions();
-            // eval <-> apply
-            Scope* env = evaluateArguments(func.func, args);
-            applyFunction(func.func, env);
+            // eval <-> apply, the callee stays on the stack for the duration
+            Scope* env = evaluateArguments(func.func(), expr->getArguments()->getExpressions());
+            if (expr->isTailCall()) {
+                tailEnv = env;
+                completion = TAILCALL;
+                return;
+            }
+            applyFunction(func.func(), env);
+            Object result = sf.pop();
+            sf.pop();
+            sf.push(result);
         }
         void visit(IdExpr* expr) {
-            sf.push(cxt.getAt(expr->getToken().getString(), expr->getToken().scopeLevel()));
+            sf.push(cxt.getAt(expr->getToken().slotIndex(), expr->getToken().scopeLevel()));
         }
         void visit(ArrayConstructorExpr* expr) {
-            vector<Object>* arr = new vector<Object>();
+            int base = sf.size();
             for (auto t : expr->getExpressions()) {
                 t->accept(this);
-                arr->push_back(sf.pop());
+            }
+            //keys and values alternate on the stack
+            if (expr->getToken().getSymbol() == TK_LC) {
+                DictObject* dict = heap.make<DictObject>();
+                for (int i = base; i < sf.size(); i += 2)
+                    dict->put(sf.get(i), sf.get(i + 1));
+                while (sf.size() > base) sf.pop();
+                sf.push(Object(dict));
+                return;
+            }
+            if (expr->getToken().getSymbol() == TK_ORDERED) {
+                OrderedMapObject* map = heap.make<OrderedMapObject>();
+                for (int i = base; i < sf.size(); i += 2)
+                    map->put(sf.get(i), sf.get(i + 1));
+                while (sf.size() > base) sf.pop();
+                sf.push(Object(map));
+                return;
+            }
+            ArrayObject* arr = heap.make<ArrayObject>(sf.size() - base);
+            for (int i = arr->size() - 1; i >= 0; i--) {
+                arr->at(i) = sf.pop();
             }
             sf.push(Object(arr));
         }
         void visit(SubscriptExpr* expr) {
+            bool member = expr->getToken().getSymbol() == TK_PERIOD;
             expr->getName()->accept(this);
-            Object arr = sf.pop();
-            if (arr.type == ARRAY) {
+            if (!member)
                 expr->getSubsript()->accept(this);
-                Object idx = sf.pop();
-                sf.push(arr.arr->at(idx.numval));
-            } else if (arr.type == OBJECT) {
-                ClassObject* co = arr.clazz;
-                string name = expr->getSubsript()->getToken().getString();
-                if (co->fields.find(name) == co->fields.end()) {
-                    cout<<name<<"? never heard of it for a  "<<co->getTypeName()<<endl;
+            Object idx = member ? Object():sf.pop();
+            Object arr = sf.pop();
+            if (arr.type() == ARRAY) {
+                sf.push(arr.arr()->at(idx.intval()));
+            } else if (arr.type() == DICT) {
+                sf.push(arr.dict()->get(idx));
+            } else if (arr.type() == ORDERED) {
+                sf.push(arr.ordered()->get(idx));
+            } else if (arr.type() == OBJECT) {
+                ClassObject* co = arr.clazz();
+                int name = expr->getSubsript()->getToken().atomId();
+                auto field = co->fields.find(name);
+                if (field == co->fields.end()) {
+                    cout<<expr->getSubsript()->getToken().getString()<<"? never heard of it for a  "<<co->getTypeName()<<endl;
+                    sf.push(Object());
                     return;
                 }
-                sf.push(co->fields[name]);
+                sf.push(field->second);
+            } else {
+                sf.push(Object());
             }
         }
         void visit(BinaryOpExpr* expr) {
+            int spec = expr->getSpecialization();
+            if ((spec & SPEC_MASK) >= SPEC_ADD) {
+                int left = (spec >> LEFT_SHAPE) & 3, right = (spec >> RIGHT_SHAPE) & 3;
+                Object lhs, rhs;
+                //nothing can run between two in place reads, otherwise the
+                //left value has to wait on the stack where the collector sees it
+                if (left != OPERAND_ANY && right != OPERAND_ANY) {
+                    lhs = operand(expr->getLeft(), left);
+                    rhs = operand(expr->getRight(), right);
+                } else {
+                    pushOperand(expr->getLeft(), left);
+                    pushOperand(expr->getRight(), right);
+                    rhs = sf.pop();
+                    lhs = sf.pop();
+                }
+                if (lhs.isInteger() && rhs.isInteger()) {
+                    applyInteger(spec & SPEC_MASK, lhs.intval(), rhs.intval());
+                    return;
+                }
+                if (lhs.isNumber() && rhs.isNumber()) {
+                    applyNumeric(spec & SPEC_MASK, lhs.numval(), rhs.numval());
+                    return;
+                }
+                expr->setSpecialization(SPEC_GENERIC);
+                applyBinaryOperator(expr, lhs, rhs);
+                return;
+            }
+            switch (expr->getToken().getSymbol()) {
+                case TK_ASSIGN: case TK_ASSIGN_SUM: case TK_ASSIGN_DIFF:
+                    handleAssignment(expr);
+                    return;
+                default:
+                    break;
+            }
             expr->getLeft()->accept(this);
-            Object lhs = sf.pop();
             expr->getRight()->accept(this);
             Object rhs = sf.pop();
+            Object lhs = sf.pop();
+            if (spec == SPEC_UNSEEN)
+                specialize(expr, lhs, rhs);
             applyBinaryOperator(expr, lhs, rhs);
         }
         void visit(UnaryOpExpr* expr) {
             expr->getExpr()->accept(this);
             Object v = sf.pop();
             switch (expr->getToken().getSymbol()) {
-                case TK_SUB: v.numval = -v.numval; break;
-                case TK_INCREMENT: v.numval += 1; break;
-                case TK_DECREMENT: v.numval -= 1; break;
+                case TK_SUB: v = neg(v); break;
+                case TK_INCREMENT: v = increment(v, 1); break;
+                case TK_DECREMENT: v = increment(v, -1); break;
+                default: break;
             }
             sf.push(v);
-            string name = expr->getExpr()->getToken().getString();
-            int depth = expr->getExpr()->getToken().scopeLevel();
-            cxt.putAt(name, v, depth);
+            if (expr->getToken().getSymbol() != TK_SUB) {
+                Token& tk = expr->getExpr()->getToken();
+                cxt.putAt(tk.slotIndex(), v, tk.scopeLevel());
+            }
         }
         void visit(ListOpExpr* expr) {
             expr->getList()->accept(this);
-            Object m = sf.pop();
-            if (m.type != ARRAY) {
+            ObjectType listType = sf.top().type();
+            if (listType != ARRAY && listType != DICT && listType != ORDERED) {
                 cout<<"Error: "<<expr->getToken().getString()<<" expects a list."<<endl;
+                sf.pop();
                 sf.push(Object());
+                return;
+            }
+            int operands = 1;
+            if (expr->getExpr() != nullptr) {
+                expr->getExpr()->accept(this);
+                operands++;
+            }
+            //operands stay on the stack until the operation is done
+            Object m = sf.get(sf.size() - operands);
+            Object arg = operands > 1 ? sf.top():Object();
+            Object result;
+            if (m.type() != ARRAY) {
+                if (m.type() == DICT)
+                    result = dictOp(expr->getToken().getSymbol(), m.dict(), arg);
+                else
+                    result = orderedOp(expr->getToken().getSymbol(), m.ordered(), arg);
+                while (operands-- > 0) sf.pop();
+                sf.push(result);
+                return;
             }
             switch (expr->getToken().getSymbol()) {
-                case TK_EMPTY: {  sf.push(Object(m.arr->empty())); } break;
-                case TK_SIZE:  {  sf.push(Object((double)m.arr->size())); } break;
-                case TK_FIRST: {  sf.push(m.arr->at(0)); } break;
-                case TK_MAP:   {  doMap(expr, m);    } break;
-                case TK_FILTER: { doFilter(expr, m); } break;
-                case TK_POP:    { doPop(m);        } break;
-                case TK_REST:   { doCdr(m);          } break;
-                case TK_APPEND: { doAppend(expr, m); } break;
-                case TK_GET:    { doGet(expr, m);    } break;
-                case TK_PUSH:   { doPush(expr, m);   } break;
-                case TK_REDUCE: {  } break;
+                case TK_EMPTY:  result = Object(m.arr()->empty()); break;
+                case TK_SIZE:   result = Object((int64_t)m.arr()->size()); break;
+                case TK_FIRST:  result = m.arr()->at(0); break;
+                case TK_LAST:   result = m.arr()->back(); break;
+                case TK_MAP:    result = doMap(m, arg); break;
+                case TK_FILTER: result = doFilter(m, arg); break;
+                case TK_POP:    result = doPop(m); break;
+                case TK_REST:   result = doCdr(m); break;
+                case TK_APPEND: result = doAppend(m, arg); break;
+                case TK_GET:    result = doGet(m, arg); break;
+                case TK_PUSH:   result = doPush(m, arg); break;
+                case TK_CONTAINS: result = Object(listContains(m.arr(), arg)); break;
+                case TK_DELETE: result = Object(listDelete(m.arr(), arg)); break;
+                case TK_PUT:    result = listPut(m.arr(), arg); break;
+                case TK_REDUCE:
                 default:
                     break;
             }
+            while (operands-- > 0) sf.pop();
+            sf.push(result);
         }
+        //numbers and strings were decoded into the pool when the program was resolved
         void visit(ConstExpr* expr) {
+            if (expr->getConstant() >= 0) {
+                sf.push(constants->get(expr->getConstant()));
+                return;
+            }
             switch (expr->getToken().getSymbol()) {
-                case TK_NUMBER: sf.push(Object(stod(expr->getToken().getString()))); break;
-                case TK_STRING: sf.push(Object(expr->getToken().getString())); break;
                 case TK_TRUE:   sf.push(Object(true)); break;
                 case TK_FALSE:  sf.push(Object(false)); break;
                 case TK_NULL:   sf.push(cxt.getNil()); break;
                 default:
+                    sf.push(Object());
                     break;
             }
         }
         void visit(BlockStmt* stmt) {
-            Scope* ar = new Scope(cxt.getStack(), cxt.getStack());
+            Scope* ar = heap.make<Scope>(cxt.getStack(), cxt.getStack(), stmt->getFrameSize());
             cxt.openScope(ar);
             stmt->getStatements()->accept(this);
             cxt.closeScope();
@@ -377,31 +709,31 @@ class Interpreter : public Visitor {
         }
         void visit(ObjectConstructorExpr* expr) {
             string name = expr->getName()->getToken().getString();
-            ClassObject* bt = cxt.getClassDef(name);
+            ClassObject* bt = cxt.getClassDef(expr->getName()->getToken().atomId());
             if (bt == nullptr) {
                 cout<<"Can't instantiate non-existant type: "<<name<<endl;
+                sf.push(Object());
                 return;
             }
-            ClassObject* nobj = new ClassObject();
-            nobj->typeName = name;
+            ClassObject* nobj = heap.make<ClassObject>();
+            nobj->typeName = bt->typeName;
             for (auto t : bt->fields) {
-                cout<<name<<" inherits "<<t.first<<endl;
+                TRACE(TRACE_INTERPRETER, name << " inherits " << atoms.nameOf(t.first));
                 nobj->fields[t.first] = Object();  
             }
             nobj->instantiated = true;
             sf.push(Object(nobj));
         }
         void visit(ObjectDefStmt* stmt) {
-            ClassObject* t = new ClassObject();
-            string name = stmt->getName()->getToken().getString();
-            t->typeName = name;
+            ClassObject* t = heap.make<ClassObject>();
+            t->typeName = stmt->getName()->getToken().atomId();
             t->instantiated = false;
             for (auto q : stmt->getBody()->getList()) {
                 LetStmt* ls = ((LetStmt*)q);
                 IdExpr* n = (IdExpr*)(ls->getExpression());
-                t->setMember(n->getToken().getString(), Object());
+                t->setMember(n->getToken().atomId(), Object());
             }
-            cxt.addClassDef(t->getTypeName(), t);
+            cxt.addClassDef(t->getTypeAtom(), t);
             cout<<"'"<<t->getTypeName()<<"' defined."<<endl;
         }
 };
@@ -2,7 +2,17 @@
 #define object_hpp
 #include <iostream>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <string_view>
+#include <vector>
+#include <stdexcept>
+#include <unordered_map>
 #include "../parse/ast.hpp"
+#include "gc.hpp"
+#include "../intern.hpp"
+#include "../trace.hpp"
 using namespace std;
 
  enum ObjectType {
@@ -13,20 +23,30 @@ using namespace std;
     ARRAY  = 5,
     OBJECT = 6,
     POINTER  = 7,
-    NIL    = 8
+    NIL    = 8,
+    INTEGER = 9,
+    DICT   = 10,
+    ORDERED = 11
 };
 
 struct Scope;
+struct CodeObject;
 
-class Function {
+class Function : public GCObject {
     private:
         friend class Interpreter;
+        friend class VM;
+        friend class FlatEvaluator;
         Scope* closure;
         IdExpr* name;
         StatementList* params;
         StatementList* body;
+        CodeObject* code;
+        int frameSize;
+        //function record in the flat tree, -1 for the other engines
+        int entry;
     public:
-        Function() {
+        Function() : closure(nullptr), name(nullptr), params(nullptr), body(nullptr), code(nullptr), frameSize(0), entry(-1) {
 
         }
         StatementList* getParams() {
@@ -41,192 +61,1570 @@ class Function {
         Scope* getClosure() {
             return closure;
         }
+        CodeObject* getCode() {
+            return code;
+        }
+        int getFrameSize() {
+            return frameSize;
+        }
+        void trace(Heap& heap);
+        size_t footprint() {
+            return sizeof(Function);
+        }
+};
+
+//the characters of one or more strings, see StringObject
+struct StringStorage : public GCObject {
+    string text;
+    StringStorage(string s) : text(std::move(s)) { }
+    size_t footprint() {
+        return sizeof(StringStorage) + text.capacity();
+    }
+};
+
+//A string is the first length characters of a buffer. Appending to the
+//string that ends where its buffer does, the last one built on it, grows
+//the buffer in place and gives a longer string over the same buffer, the
+//shorter ones still read what they did. So building a string up a piece
+//at a time is amortized O(1) per piece instead of a copy of everything
+//so far. Appending to any other string copies it to a new buffer first.
+//atom is the interned id for strings that came from a literal, strings
+//built at runtime aren't interned and have an atom of -1. Literals are
+//shared by every use of them, their buffer is never grown.
+struct StringObject : public GCObject {
+    StringStorage* buffer;
+    size_t length;
+    int atom;
+    //hashed the first time it's asked for, 0 until then
+    size_t hashCode;
+    StringObject(string s, int id = -1) : buffer(heap.make<StringStorage>(std::move(s))), length(buffer->text.size()), atom(id), hashCode(0) { }
+    StringObject(StringStorage* b, size_t len) : buffer(b), length(len), atom(-1), hashCode(0) { }
+    string_view view() const {
+        return string_view(buffer->text.data(), length);
+    }
+    string str() const {
+        return string(view());
+    }
+    size_t hash() {
+        if (hashCode == 0)
+            hashCode = std::hash<string_view>()(view()) | 1;
+        return hashCode;
+    }
+    StringObject* append(string_view tail) {
+        if (atom >= 0 || length != buffer->text.size()) {
+            string text;
+            text.reserve(length + tail.size());
+            text.append(view()).append(tail);
+            return heap.make<StringObject>(std::move(text));
+        }
+        size_t capacity = buffer->text.capacity();
+        buffer->text.append(tail);
+        heap.grew(buffer->text.capacity() - capacity);
+        return heap.make<StringObject>(buffer, buffer->text.size());
+    }
+    void trace(Heap& heap) {
+        heap.mark(buffer);
+    }
+    size_t footprint() {
+        return sizeof(StringObject);
+    }
 };
 
 class ClassObject;
+class DictObject;
+class OrderedMapObject;
+struct ArrayObject;
 string objToString(ClassObject* o);
+
+//Values are read and built through the accessors below so the engines don't
+//care how an Object is laid out. By default it's a tagged union, building
+//with -DGHOST_NANBOX packs every value into a single 8 byte word instead.
+#ifdef GHOST_NANBOX
+//Any bit pattern without the quiet NaN bits in QNAN set is a double. The
+//doubles the engines can produce (including 0/0) never land in that space,
+//so inside it the sign bit and bits 48-49 make a 3 bit tag and the low
+//48 bits hold either a pointer, one of the singletons or an integer.
+const uint64_t QNAN      = 0x7ffc000000000000;
+const uint64_t SIGN_BIT  = 0x8000000000000000;
+const uint64_t PAYLOAD   = 0x0000ffffffffffff;
+//every tag is taken, dictionaries share TAG_OBJECT with class instances
+//and ordered maps share TAG_ARRAY with lists, both set the top payload
+//bit, which user space pointers never use
+const uint64_t ALT_POINTER = 0x0000800000000000;
+
+//integers that fit in 48 bits are stored in the payload, wider ones are
+//boxed on the heap
+const int64_t SMALL_INT_MIN = -((int64_t)1 << 47);
+const int64_t SMALL_INT_MAX = ((int64_t)1 << 47) - 1;
+
+struct IntegerObject : public GCObject {
+    int64_t value;
+    IntegerObject(int64_t v) : value(v) { }
+    size_t footprint() {
+        return sizeof(IntegerObject);
+    }
+};
+
+enum BoxTag {
+    TAG_SINGLETON = 0,
+    TAG_INTEGER   = 1,
+    TAG_BIG_INT   = 2,
+    TAG_POINTER   = 3,
+    TAG_STRING    = 4,
+    TAG_ARRAY     = 5,
+    TAG_OBJECT    = 6,
+    TAG_FUNC      = 7
+};
+
+constexpr uint64_t box(int tag, uint64_t payload) {
+    return QNAN | ((uint64_t)(tag & 4) << 61) | ((uint64_t)(tag & 3) << 48) | payload;
+}
+
+const uint64_t NIL_VAL   = box(TAG_SINGLETON, 1);
+const uint64_t FALSE_VAL = box(TAG_SINGLETON, 2);
+const uint64_t TRUE_VAL  = box(TAG_SINGLETON, 3);
+//the top 16 bits of an inline and of a boxed integer
+const uint64_t INT_TOP     = box(TAG_INTEGER, 0) >> 48;
+const uint64_t BIG_INT_TOP = box(TAG_BIG_INT, 0) >> 48;
+
 struct Object {
-    ObjectType type;
-    bool marked;
+    uint64_t bits;
+    Object(string s) : bits(box(TAG_STRING, (uintptr_t)heap.make<StringObject>(s))) { }
+    Object(StringObject* s) : bits(box(TAG_STRING, (uintptr_t)s)) { }
+    Object(double d) { memcpy(&bits, &d, sizeof(double)); }
+    Object(int64_t i) {
+        if (i >= SMALL_INT_MIN && i <= SMALL_INT_MAX)
+            bits = box(TAG_INTEGER, (uint64_t)i & PAYLOAD);
+        else
+            bits = box(TAG_BIG_INT, (uintptr_t)heap.make<IntegerObject>(i));
+    }
+    Object(bool b) : bits(b ? TRUE_VAL:FALSE_VAL) { }
+    Object(Function* f) : bits(box(TAG_FUNC, (uintptr_t)f)) { }
+    Object(ArrayObject* a) : bits(box(TAG_ARRAY, (uintptr_t)a)) { }
+    Object(ClassObject* o) : bits(box(TAG_OBJECT, (uintptr_t)o)) { }
+    Object(DictObject* d) : bits(box(TAG_OBJECT, (uintptr_t)d | ALT_POINTER)) { }
+    Object(OrderedMapObject* m) : bits(box(TAG_ARRAY, (uintptr_t)m | ALT_POINTER)) { }
+    Object() : bits(NIL_VAL) { }
+    int tag() const {
+        return ((bits >> 61) & 4) | ((bits >> 48) & 3);
+    }
+    bool isDouble() const {
+        return (bits & QNAN) != QNAN;
+    }
+    bool isSmallInteger() const {
+        return (bits >> 48) == INT_TOP;
+    }
+    bool isBigInteger() const {
+        return (bits >> 48) == BIG_INT_TOP;
+    }
+    bool isInteger() const {
+        return isSmallInteger() || isBigInteger();
+    }
+    bool isNumber() const {
+        return isDouble() || isInteger();
+    }
+    ObjectType type() const {
+        if (isDouble())
+            return NUMBER;
+        switch (tag()) {
+            case TAG_SINGLETON: return bits == NIL_VAL ? NIL:BOOL;
+            case TAG_INTEGER: case TAG_BIG_INT: return INTEGER;
+            case TAG_POINTER: return POINTER;
+            case TAG_STRING: return STRING;
+            case TAG_ARRAY: return bits & ALT_POINTER ? ORDERED:ARRAY;
+            case TAG_OBJECT: return bits & ALT_POINTER ? DICT:OBJECT;
+            case TAG_FUNC: return FUNC;
+        }
+        return NIL;
+    }
+    //integers read as the nearest double
+    double numval() const {
+        if (isInteger())
+            return (double)intval();
+        double d;
+        memcpy(&d, &bits, sizeof(double));
+        return d;
+    }
+    //doubles read truncated toward zero
+    int64_t intval() const {
+        if (isSmallInteger())
+            return (int64_t)(bits << 16) >> 16;
+        if (isBigInteger())
+            return bigInteger()->value;
+        return (int64_t)numval();
+    }
+    IntegerObject* bigInteger() const { return (IntegerObject*)(bits & PAYLOAD); }
+    bool boolval() const { return bits == TRUE_VAL; }
+    StringObject* strval() const { return (StringObject*)(bits & PAYLOAD); }
+    Function* func() const { return (Function*)(bits & PAYLOAD); }
+    ClassObject* clazz() const { return (ClassObject*)(bits & PAYLOAD); }
+    ArrayObject* arr() const { return (ArrayObject*)(bits & PAYLOAD); }
+    DictObject* dict() const { return (DictObject*)(bits & PAYLOAD & ~ALT_POINTER); }
+    OrderedMapObject* ordered() const { return (OrderedMapObject*)(bits & PAYLOAD & ~ALT_POINTER); }
+    Object* obj() const { return (Object*)(bits & PAYLOAD); }
+    string toString();
+    size_t hash() const;
+    void print() {
+        cout<<this->toString()<<endl;
+    }
+};
+#else
+struct Object {
+    ObjectType tag;
     union {
-        string* strval;
+        StringObject* strval;
         double numval;
+        int64_t intval;
         bool boolval;
         Function* func;
         ClassObject* clazz;
-        vector<Object>* arr;
+        ArrayObject* arr;
+        DictObject* dict;
+        OrderedMapObject* ordered;
         Object* obj;
-    };
-    Object(string s) : type(ObjectType::STRING), strval(new string(s)), marked(false) { }
-    Object(double d) : type(ObjectType::NUMBER), numval(d), marked(false) { }
-    Object(bool b) : type(ObjectType::BOOL), boolval(b), marked(false) { }
-    Object(Function* f) : type(ObjectType::FUNC), func(f), marked(false) { }
-    Object(vector<Object>* a) : type(ObjectType::ARRAY), arr(a), marked(false) { }
-    Object(ClassObject* o) : type(ObjectType::OBJECT), clazz(o), marked(false) { }
-    Object() : type(ObjectType::NIL), numval(0), marked(false) { } 
-    Object(const Object& o) {
-        type = o.type;
-        marked = o.marked;
-        switch (o.type) {
-            case STRING: strval = o.strval; break;
-            case NUMBER: numval = o.numval; break;
-            case BOOL: boolval = o.boolval; break;
-            case FUNC: func = o.func; break;
-            case ARRAY: arr = o.arr; break;
-            case OBJECT: clazz = o.clazz; break;
-        }
-    }
-    Object& operator=(const Object& o) {
-        if (this != &o) {
-            type = o.type;
-            marked = o.marked;
-            switch (o.type) {
-                case STRING: strval = o.strval; break;
-                case NUMBER: numval = o.numval; break;
-                case BOOL: boolval = o.boolval; break;
-                case FUNC: func = o.func; break;
-                case ARRAY: arr = o.arr; break;
-                case OBJECT: clazz = o.clazz; break;
-            }
-        }
-        return *this;
-    }
-    string toString() {
-        switch (type) {
-            case STRING: return *strval; 
-            case NUMBER: {
-                if (numval == floor(numval)) 
-                    return to_string((int)numval);
-                return to_string(numval);
-            } break;
-            case BOOL: return (boolval ? "true":"false");
-            case FUNC:  return "(func)";
-            case OBJECT: {
-                return objToString(clazz);
-            } break;
-            case ARRAY: {
-                string asStr = "[ ";
-                for (auto m : *arr) {
-                    asStr += m.toString() + " ";
-                }
-                asStr += "]";
-                return asStr;
-            } break;
-            case POINTER: {
-                string asStr = "Pointer to -> " + obj->toString();
-                return asStr;
-            }
-        }
-        return "null";
-    }
+    } as;
+    Object(string s) : tag(ObjectType::STRING) { as.strval = heap.make<StringObject>(s); }
+    Object(StringObject* s) : tag(ObjectType::STRING) { as.strval = s; }
+    Object(double d) : tag(ObjectType::NUMBER) { as.numval = d; }
+    Object(int64_t i) : tag(ObjectType::INTEGER) { as.intval = i; }
+    Object(bool b) : tag(ObjectType::BOOL) { as.numval = 0; as.boolval = b; }
+    Object(Function* f) : tag(ObjectType::FUNC) { as.func = f; }
+    Object(ArrayObject* a) : tag(ObjectType::ARRAY) { as.arr = a; }
+    Object(ClassObject* o) : tag(ObjectType::OBJECT) { as.clazz = o; }
+    Object(DictObject* d) : tag(ObjectType::DICT) { as.dict = d; }
+    Object(OrderedMapObject* m) : tag(ObjectType::ORDERED) { as.ordered = m; }
+    Object() : tag(ObjectType::NIL) { as.numval = 0; }
+    bool isDouble() const { return tag == NUMBER; }
+    bool isInteger() const { return tag == INTEGER; }
+    bool isNumber() const { return tag == NUMBER || tag == INTEGER; }
+    ObjectType type() const { return tag; }
+    //integers read as the nearest double, doubles as integers truncate
+    double numval() const { return tag == INTEGER ? (double)as.intval:as.numval; }
+    int64_t intval() const { return tag == INTEGER ? as.intval:(int64_t)as.numval; }
+    //only true itself is true, like the NaN-boxed build
+    bool boolval() const { return tag == BOOL && as.boolval; }
+    StringObject* strval() const { return as.strval; }
+    Function* func() const { return as.func; }
+    ClassObject* clazz() const { return as.clazz; }
+    ArrayObject* arr() const { return as.arr; }
+    DictObject* dict() const { return as.dict; }
+    OrderedMapObject* ordered() const { return as.ordered; }
+    Object* obj() const { return as.obj; }
+    string toString();
+    size_t hash() const;
     void print() {
         cout<<this->toString()<<endl;
     }
 };
+#endif
 
-class ClassObject {
+//A list is a ring buffer. Its elements start at head and wrap around
+//the end of the storage, so adding or removing at either end is
+//amortized O(1) and indexing stays O(1). The storage is a power of two
+//long so wrapping is a mask.
+struct ArrayObject : public GCObject {
+    private:
+        vector<Object> ring;
+        size_t head;
+        size_t count;
+        size_t slot(size_t i) const {
+            return (head + i) & (ring.size() - 1);
+        }
+        static size_t capacityFor(size_t n, size_t from) {
+            size_t capacity = max(from, (size_t)8);
+            while (capacity < n)
+                capacity *= 2;
+            return capacity;
+        }
+        //unwraps into storage that holds at least n
+        void grow(size_t n) {
+            size_t capacity = capacityFor(n, ring.size());
+            if (capacity == ring.size())
+                return;
+            vector<Object> larger(capacity);
+            for (size_t i = 0; i < count; i++)
+                larger[i] = ring[slot(i)];
+            heap.grew((capacity - ring.size())*sizeof(Object));
+            ring.swap(larger);
+            head = 0;
+        }
+    public:
+        class iterator {
+            private:
+                ArrayObject* list;
+                size_t i;
+            public:
+                iterator(ArrayObject* l, size_t at) : list(l), i(at) { }
+                Object& operator*() const { return list->ring[list->slot(i)]; }
+                iterator& operator++() { i++; return *this; }
+                bool operator!=(const iterator& other) const { return i != other.i; }
+        };
+        //an empty list has no storage until something is added to it
+        ArrayObject(int n = 0) : head(0), count(n) {
+            if (n > 0)
+                ring.resize(capacityFor(n, 0));
+        }
+        size_t size() const {
+            return count;
+        }
+        bool empty() const {
+            return count == 0;
+        }
+        Object& operator[](size_t i) {
+            return ring[slot(i)];
+        }
+        //out of range throws, like the vector lists used to be
+        Object& at(size_t i) {
+            if (i >= count)
+                throw out_of_range("list index " + to_string(i) + " out of range");
+            return ring[slot(i)];
+        }
+        Object& back() {
+            return at(count - 1);
+        }
+        iterator begin() {
+            return iterator(this, 0);
+        }
+        iterator end() {
+            return iterator(this, count);
+        }
+        void reserve(size_t n) {
+            grow(n);
+        }
+        void push_back(Object m) {
+            if (count == ring.size())
+                grow(count + 1);
+            ring[slot(count)] = m;
+            count++;
+        }
+        void push_front(Object m) {
+            if (count == ring.size())
+                grow(count + 1);
+            head = (head - 1) & (ring.size() - 1);
+            ring[head] = m;
+            count++;
+        }
+        Object pop_front() {
+            Object m = at(0);
+            ring[head] = Object();
+            head = slot(1);
+            count--;
+            return m;
+        }
+        //closes the gap from whichever side has less to move
+        void erase(size_t i) {
+            if (i < count / 2) {
+                for (size_t j = i; j > 0; j--)
+                    ring[slot(j)] = ring[slot(j - 1)];
+                ring[head] = Object();
+                head = slot(1);
+            } else {
+                for (size_t j = i; j + 1 < count; j++)
+                    ring[slot(j)] = ring[slot(j + 1)];
+                ring[slot(count - 1)] = Object();
+            }
+            count--;
+        }
+        void trace(Heap& heap) {
+            for (Object& m : *this)
+                heap.mark(m);
+        }
+        size_t footprint() {
+            return sizeof(ArrayObject) + ring.capacity()*sizeof(Object);
+        }
+};
+
+class ClassObject : public GCObject {
     private:
         friend class Interpreter;
-        string typeName;
+        friend class VM;
+        friend class FlatEvaluator;
+        int typeName;
         bool instantiated;
-        unordered_map<string, Object> fields;
+        unordered_map<int, Object> fields;
     public:
-        ClassObject() {
+        ClassObject() : typeName(-1), instantiated(false) {
 
         }
-        void setName(string n) {
-            typeName = n;
+        void setName(int atom) {
+            typeName = atom;
         }
-        string getTypeName() {
+        int getTypeAtom() {
             return typeName;
         }
+        string getTypeName() {
+            return typeName < 0 ? "<anon>":atoms.nameOf(typeName);
+        }
         bool isAlive() {
             return instantiated;
         }
-        Object getMember(string name) {
+        Object getMember(int name) {
             return fields[name];
         }
-        void setMember(string name, Object m) {
+        void setMember(int name, Object m) {
             fields[name] = m;
         }
-        unordered_map<string, Object>& getFields() {
+        unordered_map<int, Object>& getFields() {
             return fields;
         }
+        void trace(Heap& heap) {
+            for (auto& m : fields)
+                heap.mark(m.second);
+        }
+        size_t footprint() {
+            return sizeof(ClassObject) + fields.size()*(sizeof(pair<int,Object>) + 2*sizeof(void*));
+        }
         string toString() {
             string str = "{";
             for (auto m : fields) {
-                str += "[ " + m.first +": " + m.second.toString()+" ] ";
+                str += "[ " + atoms.nameOf(m.first) +": " + m.second.toString()+" ] ";
             }
             str += "}";
             return str;
         }
 };
 
+bool sameValue(const Object& lhs, const Object& rhs);
+//compare() gives this for values that have no order between them
+const int UNORDERED = 2;
+int compare(const Object& lhs, const Object& rhs);
+
+//An open addressing hash table laid out like a Swiss table. Slots come
+//in groups of eight with a control byte each, the byte holds the low
+//seven bits of the key's hash while the slot is full, so a probe tests
+//a whole group's bytes at once as one 64 bit word and only compares the
+//keys whose byte matched. Groups are probed triangularly and a probe
+//ends at the first group with an empty byte. The full hash is kept with
+//each key so growing never hashes a key twice, strings cache theirs too.
+class DictObject : public GCObject {
+    private:
+        static constexpr int8_t EMPTY = -128;
+        static constexpr int8_t DELETED = -2;
+        static constexpr size_t GROUP = 8;
+        static constexpr uint64_t LSBS = 0x0101010101010101;
+        static constexpr uint64_t MSBS = 0x8080808080808080;
+        struct Slot {
+            Object key;
+            Object value;
+            size_t hash;
+        };
+        vector<int8_t> ctrl;
+        vector<Slot> slots;
+        size_t count;
+        //full and deleted slots, what counts against the load factor
+        size_t used;
+        //number of groups less one
+        size_t mask;
+        //NaN isn't equal to itself so it's never found as a key. Like the
+        //ordered map a dictionary doesn't store it, writes go here
+        Object rejected;
+        uint64_t group(size_t g) const {
+            uint64_t w;
+            memcpy(&w, ctrl.data() + g*GROUP, sizeof(w));
+            return w;
+        }
+        //a high bit for each byte equal to b, with the odd false positive
+        //that the key comparison catches
+        static uint64_t matchByte(uint64_t w, int8_t b) {
+            uint64_t x = w ^ (LSBS * (uint8_t)b);
+            return (x - LSBS) & ~x & MSBS;
+        }
+        static uint64_t matchEmpty(uint64_t w) {
+            return w & ~(w << 6) & MSBS;
+        }
+        static uint64_t matchFree(uint64_t w) {
+            return w & MSBS;
+        }
+        static size_t lowest(uint64_t m) {
+            return __builtin_ctzll(m) / 8;
+        }
+        //Object::hash is the identity for integers, so keys that differ
+        //only in their high bits would share a control byte and a first
+        //group. The finalizer from murmur3 spreads every bit over both
+        static size_t spread(size_t h) {
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccd;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53;
+            h ^= h >> 33;
+            return h;
+        }
+        static int8_t h2(size_t hash) {
+            return hash & 0x7f;
+        }
+        //the slot holding key, -1 if there isn't one
+        long find(const Object& key, size_t hash) const {
+            if (slots.empty())
+                return -1;
+            size_t g = (hash >> 7) & mask;
+            for (size_t step = 1;; step++) {
+                uint64_t w = group(g);
+                for (uint64_t m = matchByte(w, h2(hash)); m != 0; m &= m - 1) {
+                    size_t i = g*GROUP + lowest(m);
+                    if (slots[i].hash == hash && sameValue(slots[i].key, key))
+                        return i;
+                }
+                if (matchEmpty(w))
+                    return -1;
+                g = (g + step) & mask;
+            }
+        }
+        //where a key that isn't in the table goes
+        size_t freeSlot(size_t hash) const {
+            size_t g = (hash >> 7) & mask;
+            for (size_t step = 1;; step++) {
+                uint64_t m = matchFree(group(g));
+                if (m != 0)
+                    return g*GROUP + lowest(m);
+                g = (g + step) & mask;
+            }
+        }
+        //doubles when the table is mostly live keys, otherwise rebuilds
+        //at the same size to clear out the deleted ones
+        void rehash() {
+            size_t capacity = max(slots.size(), GROUP*2);
+            while ((count + 1) * 16 > capacity * 7)
+                capacity *= 2;
+            if (capacity > slots.size())
+                heap.grew((capacity - slots.size())*(sizeof(Slot) + 1));
+            vector<int8_t> oldCtrl(capacity, EMPTY);
+            vector<Slot> oldSlots(capacity);
+            oldCtrl.swap(ctrl);
+            oldSlots.swap(slots);
+            mask = capacity / GROUP - 1;
+            used = count;
+            for (size_t i = 0; i < oldSlots.size(); i++) {
+                if (oldCtrl[i] < 0)
+                    continue;
+                size_t j = freeSlot(oldSlots[i].hash);
+                ctrl[j] = oldCtrl[i];
+                slots[j] = oldSlots[i];
+            }
+        }
+        size_t insert(const Object& key, size_t hash) {
+            if ((used + 1) * 8 > slots.size() * 7)
+                rehash();
+            size_t i = freeSlot(hash);
+            if (ctrl[i] == EMPTY)
+                used++;
+            count++;
+            ctrl[i] = h2(hash);
+            slots[i].key = key;
+            slots[i].value = Object();
+            slots[i].hash = hash;
+            return i;
+        }
+    public:
+        DictObject() : count(0), used(0), mask(0) { }
+        size_t size() const {
+            return count;
+        }
+        bool empty() const {
+            return count == 0;
+        }
+        bool contains(const Object& key) const {
+            return find(key, spread(key.hash())) >= 0;
+        }
+        //nil when the key isn't there
+        Object get(const Object& key) const {
+            long i = find(key, spread(key.hash()));
+            return i < 0 ? Object():slots[i].value;
+        }
+        //the value for key, added as nil if it wasn't there. Only good
+        //until the next insert
+        Object& at(const Object& key) {
+            if (key.isDouble() && key.numval() != key.numval()) {
+                cout<<"Error: "<<Object(key).toString()<<" can't be a dictionary key."<<endl;
+                rejected = Object();
+                return rejected;
+            }
+            size_t hash = spread(key.hash());
+            long i = find(key, hash);
+            if (i < 0)
+                i = insert(key, hash);
+            return slots[i].value;
+        }
+        void put(const Object& key, Object value) {
+            at(key) = value;
+        }
+        //a slot in a group that already has an empty one can be emptied,
+        //no probe went past that group. Otherwise it has to stay marked
+        //so probes still go on to the keys after it
+        bool erase(const Object& key) {
+            long i = find(key, spread(key.hash()));
+            if (i < 0)
+                return false;
+            if (matchEmpty(group(i / GROUP))) {
+                ctrl[i] = EMPTY;
+                used--;
+            } else {
+                ctrl[i] = DELETED;
+            }
+            slots[i].key = Object();
+            slots[i].value = Object();
+            slots[i].hash = 0;
+            count--;
+            return true;
+        }
+        //the keys in table order, which is no order in particular
+        ArrayObject* keys() {
+            ArrayObject* list = heap.make<ArrayObject>();
+            list->reserve(count);
+            forEach([&](Object& key, Object& value) { list->push_back(key); });
+            return list;
+        }
+        template <class F>
+        void forEach(F visit) {
+            for (size_t i = 0; i < slots.size(); i++)
+                if (ctrl[i] >= 0)
+                    visit(slots[i].key, slots[i].value);
+        }
+        void trace(Heap& heap) {
+            forEach([&](Object& key, Object& value) {
+                heap.mark(key);
+                heap.mark(value);
+            });
+        }
+        size_t footprint() {
+            return sizeof(DictObject) + ctrl.capacity() + slots.capacity()*sizeof(Slot);
+        }
+        string toString() {
+            string str = "{ ";
+            bool first = true;
+            forEach([&](Object& key, Object& value) {
+                str += (first ? "":", ") + key.toString() + ": " + value.toString();
+                first = false;
+            });
+            return str + " }";
+        }
+};
+
+//A B-tree of up to 31 keys a node, keys and values in their own arrays
+//so a node's keys binary search through a few cache lines. It keeps the
+//keys in order, so besides lookups it answers min and max, floor and
+//ceiling and range scans in O(log n), and walks in key order. Keys are
+//numbers, strings, bools or lists of them; numbers sort before strings,
+//strings before bools and bools before lists.
+class OrderedMapObject : public GCObject {
+    private:
+        static constexpr int T = 16;
+        static constexpr int MAX_KEYS = 2*T - 1;
+        struct Node {
+            int n;
+            bool leaf;
+            Object keys[MAX_KEYS];
+            Object values[MAX_KEYS];
+            Node* child[MAX_KEYS + 1];
+            Node(bool isLeaf) : n(0), leaf(isLeaf) { }
+        };
+        Node* root;
+        size_t count;
+        size_t nodes;
+        //where writes to a key that can't be ordered go
+        Object rejected;
+        static int rank(const Object& key) {
+            if (key.isNumber()) return 0;
+            switch (key.type()) {
+                case STRING: return 1;
+                case BOOL: return 2;
+                default:
+                    break;
+            }
+            return 3;
+        }
+        static int order(const Object& lhs, const Object& rhs) {
+            int l = rank(lhs), r = rank(rhs);
+            if (l != r)
+                return l < r ? -1:1;
+            if (l < 3)
+                return compare(lhs, rhs);
+            ArrayObject* a = lhs.arr();
+            ArrayObject* b = rhs.arr();
+            size_t n = min(a->size(), b->size());
+            for (size_t i = 0; i < n; i++) {
+                int c = order((*a)[i], (*b)[i]);
+                if (c != 0)
+                    return c;
+            }
+            return a->size() < b->size() ? -1:a->size() > b->size();
+        }
+        //the first slot in x whose key isn't less than key
+        static int lowerBound(Node* x, const Object& key) {
+            int lo = 0, hi = x->n;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (order(x->keys[mid], key) < 0)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            return lo;
+        }
+        Node* makeNode(bool leaf) {
+            nodes++;
+            heap.grew(sizeof(Node));
+            return new Node(leaf);
+        }
+        void freeNode(Node* x) {
+            nodes--;
+            delete x;
+        }
+        void freeTree(Node* x) {
+            if (!x->leaf)
+                for (int i = 0; i <= x->n; i++)
+                    freeTree(x->child[i]);
+            freeNode(x);
+        }
+        Object* find(const Object& key) const {
+            if (!orderable(key))
+                return nullptr;
+            for (Node* x = root; x != nullptr; ) {
+                int i = lowerBound(x, key);
+                if (i < x->n && order(x->keys[i], key) == 0)
+                    return &x->values[i];
+                x = x->leaf ? nullptr:x->child[i];
+            }
+            return nullptr;
+        }
+        //moves x's entry i up out of a full child i, which becomes two
+        void split(Node* x, int i) {
+            Node* y = x->child[i];
+            Node* z = makeNode(y->leaf);
+            z->n = T - 1;
+            for (int j = 0; j < T - 1; j++) {
+                z->keys[j] = y->keys[j + T];
+                z->values[j] = y->values[j + T];
+            }
+            if (!y->leaf)
+                for (int j = 0; j < T; j++)
+                    z->child[j] = y->child[j + T];
+            y->n = T - 1;
+            for (int j = x->n; j > i; j--) {
+                x->keys[j] = x->keys[j - 1];
+                x->values[j] = x->values[j - 1];
+                x->child[j + 1] = x->child[j];
+            }
+            x->keys[i] = y->keys[T - 1];
+            x->values[i] = y->values[T - 1];
+            x->child[i + 1] = z;
+            x->n++;
+        }
+        //full nodes are split on the way down so there's always room
+        Object& insert(const Object& key) {
+            if (root == nullptr)
+                root = makeNode(true);
+            if (root->n == MAX_KEYS) {
+                Node* s = makeNode(false);
+                s->child[0] = root;
+                root = s;
+                split(s, 0);
+            }
+            Node* x = root;
+            for (;;) {
+                int i = lowerBound(x, key);
+                if (x->leaf) {
+                    for (int j = x->n; j > i; j--) {
+                        x->keys[j] = x->keys[j - 1];
+                        x->values[j] = x->values[j - 1];
+                    }
+                    x->keys[i] = key;
+                    x->values[i] = Object();
+                    x->n++;
+                    count++;
+                    return x->values[i];
+                }
+                if (x->child[i]->n == MAX_KEYS) {
+                    split(x, i);
+                    if (order(x->keys[i], key) < 0)
+                        i++;
+                }
+                x = x->child[i];
+            }
+        }
+        //child i of x takes x's entry i and everything in child i+1
+        void merge(Node* x, int i) {
+            Node* c = x->child[i];
+            Node* s = x->child[i + 1];
+            c->keys[c->n] = x->keys[i];
+            c->values[c->n] = x->values[i];
+            for (int j = 0; j < s->n; j++) {
+                c->keys[c->n + 1 + j] = s->keys[j];
+                c->values[c->n + 1 + j] = s->values[j];
+            }
+            if (!c->leaf)
+                for (int j = 0; j <= s->n; j++)
+                    c->child[c->n + 1 + j] = s->child[j];
+            c->n += s->n + 1;
+            for (int j = i; j < x->n - 1; j++) {
+                x->keys[j] = x->keys[j + 1];
+                x->values[j] = x->values[j + 1];
+                x->child[j + 1] = x->child[j + 2];
+            }
+            x->n--;
+            freeNode(s);
+        }
+        //rotates an entry from a sibling through x into child i
+        void borrowLeft(Node* x, int i) {
+            Node* c = x->child[i];
+            Node* s = x->child[i - 1];
+            for (int j = c->n; j > 0; j--) {
+                c->keys[j] = c->keys[j - 1];
+                c->values[j] = c->values[j - 1];
+            }
+            if (!c->leaf)
+                for (int j = c->n + 1; j > 0; j--)
+                    c->child[j] = c->child[j - 1];
+            c->keys[0] = x->keys[i - 1];
+            c->values[0] = x->values[i - 1];
+            if (!c->leaf)
+                c->child[0] = s->child[s->n];
+            x->keys[i - 1] = s->keys[s->n - 1];
+            x->values[i - 1] = s->values[s->n - 1];
+            c->n++;
+            s->n--;
+        }
+        void borrowRight(Node* x, int i) {
+            Node* c = x->child[i];
+            Node* s = x->child[i + 1];
+            c->keys[c->n] = x->keys[i];
+            c->values[c->n] = x->values[i];
+            if (!c->leaf)
+                c->child[c->n + 1] = s->child[0];
+            x->keys[i] = s->keys[0];
+            x->values[i] = s->values[0];
+            for (int j = 0; j < s->n - 1; j++) {
+                s->keys[j] = s->keys[j + 1];
+                s->values[j] = s->values[j + 1];
+            }
+            if (!s->leaf)
+                for (int j = 0; j < s->n; j++)
+                    s->child[j] = s->child[j + 1];
+            c->n++;
+            s->n--;
+        }
+        //makes sure child i has a key to spare before going down into it,
+        //returns which child now covers the same keys
+        int fill(Node* x, int i) {
+            if (i > 0 && x->child[i - 1]->n >= T) {
+                borrowLeft(x, i);
+            } else if (i < x->n && x->child[i + 1]->n >= T) {
+                borrowRight(x, i);
+            } else if (i < x->n) {
+                merge(x, i);
+            } else {
+                merge(x, i - 1);
+                return i - 1;
+            }
+            return i;
+        }
+        //removes a key that's known to be under x
+        void remove(Node* x, Object key) {
+            int i = lowerBound(x, key);
+            if (i < x->n && order(x->keys[i], key) == 0) {
+                if (x->leaf) {
+                    for (int j = i; j < x->n - 1; j++) {
+                        x->keys[j] = x->keys[j + 1];
+                        x->values[j] = x->values[j + 1];
+                    }
+                    x->n--;
+                    return;
+                }
+                Node* left = x->child[i];
+                Node* right = x->child[i + 1];
+                if (left->n >= T) {
+                    Node* p = left;
+                    while (!p->leaf)
+                        p = p->child[p->n];
+                    x->keys[i] = p->keys[p->n - 1];
+                    x->values[i] = p->values[p->n - 1];
+                    remove(left, x->keys[i]);
+                } else if (right->n >= T) {
+                    Node* p = right;
+                    while (!p->leaf)
+                        p = p->child[0];
+                    x->keys[i] = p->keys[0];
+                    x->values[i] = p->values[0];
+                    remove(right, x->keys[i]);
+                } else {
+                    merge(x, i);
+                    remove(left, key);
+                }
+                return;
+            }
+            if (x->child[i]->n < T)
+                i = fill(x, i);
+            remove(x->child[i], key);
+        }
+        template <class F>
+        static void walk(Node* x, F& visit) {
+            for (int i = 0; i < x->n; i++) {
+                if (!x->leaf)
+                    walk(x->child[i], visit);
+                visit(x->keys[i], x->values[i]);
+            }
+            if (!x->leaf)
+                walk(x->child[x->n], visit);
+        }
+        //visits the keys from lo through hi in order, false once past hi
+        template <class F>
+        static bool scan(Node* x, const Object& lo, const Object& hi, F& visit) {
+            for (int i = lowerBound(x, lo); i <= x->n; i++) {
+                if (!x->leaf && !scan(x->child[i], lo, hi, visit))
+                    return false;
+                if (i == x->n)
+                    break;
+                if (order(x->keys[i], hi) > 0)
+                    return false;
+                visit(x->keys[i], x->values[i]);
+            }
+            return true;
+        }
+    public:
+        OrderedMapObject() : root(nullptr), count(0), nodes(0) { }
+        ~OrderedMapObject() {
+            if (root != nullptr)
+                freeTree(root);
+        }
+        static bool orderable(const Object& key) {
+            if (key.isNumber())
+                return key.numval() == key.numval();
+            switch (key.type()) {
+                case STRING: case BOOL: return true;
+                case ARRAY:
+                    for (const Object& m : *key.arr())
+                        if (!orderable(m))
+                            return false;
+                    return true;
+                default:
+                    break;
+            }
+            return false;
+        }
+        size_t size() const {
+            return count;
+        }
+        bool empty() const {
+            return count == 0;
+        }
+        bool contains(const Object& key) const {
+            return find(key) != nullptr;
+        }
+        //nil when the key isn't there
+        Object get(const Object& key) const {
+            Object* value = find(key);
+            return value ? *value:Object();
+        }
+        //the value for key, added as nil if it wasn't there. Only good
+        //until the next insert or delete
+        Object& at(const Object& key) {
+            if (Object* value = find(key))
+                return *value;
+            if (!orderable(key)) {
+                cout<<"Error: "<<Object(key).toString()<<" can't be an ordered map key."<<endl;
+                rejected = Object();
+                return rejected;
+            }
+            return insert(key);
+        }
+        void put(const Object& key, Object value) {
+            at(key) = value;
+        }
+        bool erase(const Object& key) {
+            if (!contains(key))
+                return false;
+            remove(root, key);
+            count--;
+            if (root->n == 0) {
+                Node* old = root;
+                root = root->leaf ? nullptr:root->child[0];
+                freeNode(old);
+            }
+            return true;
+        }
+        //the smallest and largest keys, nil when empty
+        Object first() const {
+            if (root == nullptr)
+                return Object();
+            Node* x = root;
+            while (!x->leaf)
+                x = x->child[0];
+            return x->keys[0];
+        }
+        Object last() const {
+            if (root == nullptr)
+                return Object();
+            Node* x = root;
+            while (!x->leaf)
+                x = x->child[x->n];
+            return x->keys[x->n - 1];
+        }
+        //the largest key not above key, nil if there isn't one. Going down
+        //past a key only leads to keys closer to the one asked for
+        Object floor(const Object& key) const {
+            Object best;
+            if (!orderable(key))
+                return best;
+            for (Node* x = root; x != nullptr; ) {
+                int i = lowerBound(x, key);
+                if (i < x->n && order(x->keys[i], key) == 0)
+                    return x->keys[i];
+                if (i > 0)
+                    best = x->keys[i - 1];
+                x = x->leaf ? nullptr:x->child[i];
+            }
+            return best;
+        }
+        //the smallest key not below key, nil if there isn't one
+        Object ceiling(const Object& key) const {
+            Object best;
+            if (!orderable(key))
+                return best;
+            for (Node* x = root; x != nullptr; ) {
+                int i = lowerBound(x, key);
+                if (i < x->n)
+                    best = x->keys[i];
+                if (i < x->n && order(x->keys[i], key) == 0)
+                    break;
+                x = x->leaf ? nullptr:x->child[i];
+            }
+            return best;
+        }
+        //the keys from lo through hi in order
+        ArrayObject* range(const Object& lo, const Object& hi) {
+            ArrayObject* list = heap.make<ArrayObject>();
+            auto add = [&](Object& key, Object& value) { list->push_back(key); };
+            if (root != nullptr && orderable(lo) && orderable(hi))
+                scan(root, lo, hi, add);
+            return list;
+        }
+        ArrayObject* keys() {
+            ArrayObject* list = heap.make<ArrayObject>();
+            list->reserve(count);
+            forEach([&](Object& key, Object& value) { list->push_back(key); });
+            return list;
+        }
+        //in key order
+        template <class F>
+        void forEach(F visit) {
+            if (root != nullptr)
+                walk(root, visit);
+        }
+        void trace(Heap& heap) {
+            forEach([&](Object& key, Object& value) {
+                heap.mark(key);
+                heap.mark(value);
+            });
+        }
+        size_t footprint() {
+            return sizeof(OrderedMapObject) + nodes*sizeof(Node);
+        }
+        string toString() {
+            string str = "ordered { ";
+            bool first = true;
+            forEach([&](Object& key, Object& value) {
+                str += (first ? "":", ") + key.toString() + ": " + value.toString();
+                first = false;
+            });
+            return str + " }";
+        }
+};
+
+string Object::toString() {
+    switch (type()) {
+        case STRING: return strval()->str();
+        case INTEGER: return to_string(intval());
+        case NUMBER: {
+            if (numval() == floor(numval()) && fabs(numval()) < 9.2e18)
+                return to_string((int64_t)numval());
+            return to_string(numval());
+        } break;
+        case BOOL: return (boolval() ? "true":"false");
+        case FUNC:  return "(func)";
+        case OBJECT: {
+            return objToString(clazz());
+        } break;
+        case DICT: return dict()->toString();
+        case ORDERED: return ordered()->toString();
+        case ARRAY: {
+            string asStr = "[ ";
+            for (auto m : *arr()) {
+                asStr += m.toString() + " ";
+            }
+            asStr += "]";
+            return asStr;
+        } break;
+        case POINTER: {
+            string asStr = "Pointer to -> " + obj()->toString();
+            return asStr;
+        }
+        case NIL:
+            break;
+    }
+    return "null";
+}
+
 string objToString(ClassObject* o) {
     return o == nullptr ? "nil":o->toString();
 }
 
+//string literals share one pinned StringObject per atom instead of
+//allocating a new one every time they're evaluated
+vector<StringObject*> literalStrings;
+
+StringObject* internedString(int atom) {
+    if (atom >= (int)literalStrings.size())
+        literalStrings.resize(atom+1, nullptr);
+    if (literalStrings[atom] == nullptr) {
+        literalStrings[atom] = heap.make<StringObject>(atoms.nameOf(atom), atom);
+        literalStrings[atom]->pinned = true;
+        literalStrings[atom]->buffer->pinned = true;
+    }
+    return literalStrings[atom];
+}
+
+bool sameString(StringObject* lhs, StringObject* rhs) {
+    if (lhs->atom >= 0 && rhs->atom >= 0)
+        return lhs->atom == rhs->atom;
+    if (lhs->buffer == rhs->buffer && lhs->length == rhs->length)
+        return true;
+    return lhs->view() == rhs->view();
+}
+
+void Heap::mark(Object& obj) {
+    if (obj.isDouble())
+        return;
+    switch (obj.type()) {
+        case STRING: mark(obj.strval()); break;
+        case FUNC:   mark(obj.func()); break;
+        case ARRAY:  mark(obj.arr()); break;
+        case OBJECT: mark(obj.clazz()); break;
+        case DICT:   mark(obj.dict()); break;
+        case ORDERED: mark(obj.ordered()); break;
+#ifdef GHOST_NANBOX
+        case INTEGER: if (obj.isBigInteger()) mark(obj.bigInteger()); break;
+#endif
+        default:
+            break;
+    }
+}
+
+void Heap::pin(Object& obj) {
+    if (obj.isDouble())
+        return;
+    switch (obj.type()) {
+        case STRING: obj.strval()->pinned = true; obj.strval()->buffer->pinned = true; break;
+        case FUNC:   obj.func()->pinned = true; break;
+        case ARRAY:  obj.arr()->pinned = true; break;
+        case OBJECT: obj.clazz()->pinned = true; break;
+        case DICT:   obj.dict()->pinned = true; break;
+        case ORDERED: obj.ordered()->pinned = true; break;
+#ifdef GHOST_NANBOX
+        case INTEGER: if (obj.isBigInteger()) obj.bigInteger()->pinned = true; break;
+#endif
+        default:
+            break;
+    }
+}
+
+//reads an integer literal, false when it doesn't fit in 64 bits
+bool integerLiteral(const string& text, int64_t& value) {
+    auto res = from_chars(text.data(), text.data() + text.size(), value);
+    return res.ec == errc() && res.ptr == text.data() + text.size();
+}
+
+//the value of an integer or number literal
+Object numberLiteral(Token& tk) {
+    int64_t value;
+    if (tk.getSymbol() == TK_INTEGER && integerLiteral(tk.getString(), value))
+        return Object(value);
+    return Object(stod(tk.getString()));
+}
+
+//Integer arithmetic is exact, a result that doesn't fit in 64 bits (or a
+//quotient with a remainder) comes back as a double. Mixing an integer
+//with a double gives a double.
+Object addInt(int64_t lhs, int64_t rhs) {
+    int64_t result;
+    if (__builtin_add_overflow(lhs, rhs, &result))
+        return Object((double)lhs + (double)rhs);
+    return Object(result);
+}
+Object subInt(int64_t lhs, int64_t rhs) {
+    int64_t result;
+    if (__builtin_sub_overflow(lhs, rhs, &result))
+        return Object((double)lhs - (double)rhs);
+    return Object(result);
+}
+Object mulInt(int64_t lhs, int64_t rhs) {
+    int64_t result;
+    if (__builtin_mul_overflow(lhs, rhs, &result))
+        return Object((double)lhs * (double)rhs);
+    return Object(result);
+}
+Object divInt(int64_t lhs, int64_t rhs) {
+    if (rhs == 0 || (rhs == -1 && lhs == INT64_MIN) || lhs % rhs != 0)
+        return Object((double)lhs / (double)rhs);
+    return Object(lhs / rhs);
+}
+Object modInt(int64_t lhs, int64_t rhs) {
+    if (rhs == 0)
+        return Object(std::fmod((double)lhs, (double)rhs));
+    return Object(rhs == -1 ? (int64_t)0:lhs % rhs);
+}
+
 Object add(Object lhs, Object rhs) {
-    if (lhs.type == NUMBER && rhs.type == NUMBER)
-        return Object(lhs.numval + rhs.numval);
-    cout<<"Adding string wise."<<endl;
+    if (lhs.isInteger() && rhs.isInteger())
+        return addInt(lhs.intval(), rhs.intval());
+    if (lhs.isNumber() && rhs.isNumber())
+        return Object(lhs.numval() + rhs.numval());
+    TRACE(TRACE_INTERPRETER, "Adding string wise.");
+    if (lhs.type() == STRING) {
+        StringObject* str = lhs.strval();
+        if (rhs.type() != STRING)
+            return Object(str->append(rhs.toString()));
+        //a string appended to itself would be read while it grows
+        if (rhs.strval()->buffer == str->buffer)
+            return Object(str->append(rhs.strval()->str()));
+        return Object(str->append(rhs.strval()->view()));
+    }
     return Object(string(lhs.toString() + rhs.toString()));
 }
 Object sub(Object lhs, Object rhs) {
-    if (lhs.type != NUMBER)
+    if (!lhs.isNumber())
         return lhs;
-    if (rhs.type != NUMBER)
+    if (!rhs.isNumber())
         return rhs;
-    return Object(lhs.numval - rhs.numval);
+    if (lhs.isInteger() && rhs.isInteger())
+        return subInt(lhs.intval(), rhs.intval());
+    return Object(lhs.numval() - rhs.numval());
 }
-Object gt(Object lhs, Object rhs) {
-    if (lhs.type != rhs.type)
-        return Object(false);
-    switch (lhs.type) {
-        case NUMBER: return Object(lhs.numval > rhs.numval);
-        case BOOL: return Object(lhs.boolval > rhs.boolval);
-        case STRING: return Object(lhs.toString() > rhs.toString());
+Object mul(Object lhs, Object rhs) {
+    if (lhs.isInteger() && rhs.isInteger())
+        return mulInt(lhs.intval(), rhs.intval());
+    return Object(lhs.numval() * rhs.numval());
+}
+Object div(Object lhs, Object rhs) {
+    if (lhs.isInteger() && rhs.isInteger())
+        return divInt(lhs.intval(), rhs.intval());
+    return Object(lhs.numval() / rhs.numval());
+}
+Object mod(Object lhs, Object rhs) {
+    if (lhs.isInteger() && rhs.isInteger())
+        return modInt(lhs.intval(), rhs.intval());
+    return Object(std::fmod(lhs.numval(), rhs.numval()));
+}
+Object neg(Object v) {
+    if (v.isInteger() && v.intval() != INT64_MIN)
+        return Object(-v.intval());
+    return Object(-v.numval());
+}
+//++ and --, step is 1 or -1. Anything that isn't a number counts as 0,
+//its numval would be whatever bits it holds
+Object increment(Object v, int64_t step) {
+    if (v.isInteger())
+        return addInt(v.intval(), step);
+    if (!v.isDouble())
+        return Object(step);
+    return Object(v.numval() + step);
+}
+//Arrays are equal element by element and objects of the same class field
+//by field, both stop at the first difference.
+bool sameArray(ArrayObject* lhs, ArrayObject* rhs) {
+    if (lhs == rhs)
+        return true;
+    if (lhs->size() != rhs->size())
+        return false;
+    for (size_t i = 0; i < lhs->size(); i++)
+        if (!sameValue((*lhs)[i], (*rhs)[i]))
+            return false;
+    return true;
+}
+bool sameFields(ClassObject* lhs, ClassObject* rhs) {
+    if (lhs == rhs)
+        return true;
+    if (lhs->getTypeAtom() != rhs->getTypeAtom()) {
+        TRACE(TRACE_INTERPRETER, "Not even the same type!");
+        return false;
+    }
+    auto& theirs = rhs->getFields();
+    if (lhs->getFields().size() != theirs.size())
+        return false;
+    for (auto& m : lhs->getFields()) {
+        auto q = theirs.find(m.first);
+        if (q == theirs.end() || !sameValue(m.second, q->second)) {
+            TRACE(TRACE_INTERPRETER, "Failed on " << atoms.nameOf(m.first));
+            return false;
+        }
     }
-    return Object(false);
+    TRACE(TRACE_INTERPRETER, "They match!");
+    return true;
 }
-Object equ(Object lhs, Object rhs) {
-    if (lhs.type != rhs.type)
-        return Object(false);
-    switch (lhs.type) {
-        case NUMBER: return Object(lhs.numval == rhs.numval);
-        case BOOL: return Object(lhs.boolval == rhs.boolval);
-        case STRING: return Object(lhs.toString() == rhs.toString());
-        case ARRAY: return Object(lhs.toString() == rhs.toString());
-        case OBJECT: {
-            if (lhs.clazz->getTypeName() != rhs.clazz->getTypeName()) {
-                cout<<"Not even the same type!"<<endl;
-                return Object(false);
-            }
-            for (auto m : lhs.clazz->getFields()) {
-                Object q =  rhs.clazz->getMember(m.first);
-                if (equ(m.second, q).boolval == false) {
-                    cout<<"Failed on "<<m.first<<endl;
-                    return Object(false);
-                }
+//dictionaries are equal when they hold equal values under the same keys
+bool sameEntries(DictObject* lhs, DictObject* rhs) {
+    if (lhs == rhs)
+        return true;
+    if (lhs->size() != rhs->size())
+        return false;
+    bool same = true;
+    lhs->forEach([&](Object& key, Object& value) {
+        same = same && rhs->contains(key) && sameValue(value, rhs->get(key));
+    });
+    return same;
+}
+bool sameEntries(OrderedMapObject* lhs, OrderedMapObject* rhs) {
+    if (lhs == rhs)
+        return true;
+    if (lhs->size() != rhs->size())
+        return false;
+    bool same = true;
+    lhs->forEach([&](Object& key, Object& value) {
+        same = same && rhs->contains(key) && sameValue(value, rhs->get(key));
+    });
+    return same;
+}
+//An integer against a double, without converting the integer to a double
+//as that can round it: 2^53 + 1 becomes 2^53, but they aren't equal.
+int compareIntDouble(int64_t i, double d) {
+    if (d != d)
+        return UNORDERED;
+    if (d >= 9223372036854775808.0)
+        return -1;
+    if (d < -9223372036854775808.0)
+        return 1;
+    double t = trunc(d);
+    int64_t whole = (int64_t)t;
+    if (i != whole)
+        return i < whole ? -1:1;
+    return t < d ? -1:t > d;
+}
+int compareNumbers(const Object& lhs, const Object& rhs) {
+    if (lhs.isInteger() && rhs.isInteger())
+        return lhs.intval() < rhs.intval() ? -1:lhs.intval() > rhs.intval();
+    if (lhs.isInteger())
+        return compareIntDouble(lhs.intval(), rhs.numval());
+    if (rhs.isInteger()) {
+        int c = compareIntDouble(rhs.intval(), lhs.numval());
+        return c == UNORDERED ? c:-c;
+    }
+    double l = lhs.numval(), r = rhs.numval();
+    if (l < r) return -1;
+    if (l > r) return 1;
+    return l == r ? 0:UNORDERED;
+}
+
+bool sameValue(const Object& lhs, const Object& rhs) {
+    if (lhs.isInteger() && rhs.isInteger())
+        return lhs.intval() == rhs.intval();
+    if (lhs.isNumber() && rhs.isNumber())
+        return compareNumbers(lhs, rhs) == 0;
+    if (lhs.type() != rhs.type())
+        return false;
+    switch (lhs.type()) {
+        case BOOL: return lhs.boolval() == rhs.boolval();
+        case STRING: return sameString(lhs.strval(), rhs.strval());
+        case ARRAY: return sameArray(lhs.arr(), rhs.arr());
+        case OBJECT: return sameFields(lhs.clazz(), rhs.clazz());
+        case DICT: return sameEntries(lhs.dict(), rhs.dict());
+        case ORDERED: return sameEntries(lhs.ordered(), rhs.ordered());
+        case FUNC: return lhs.func() == rhs.func();
+        case NIL: return true;
+        default:
+            break;
+    }
+    return false;
+}
+
+//-1, 0 or 1. Numbers, strings and bools are ordered among their own kind
+//and arrays lexicographically by their elements, everything else only
+//compares to what it equals.
+int compare(const Object& lhs, const Object& rhs) {
+    if (lhs.isNumber() && rhs.isNumber())
+        return compareNumbers(lhs, rhs);
+    if (lhs.type() != rhs.type())
+        return UNORDERED;
+    switch (lhs.type()) {
+        case BOOL: return (int)lhs.boolval() - (int)rhs.boolval();
+        case STRING: {
+            if (sameString(lhs.strval(), rhs.strval()))
+                return 0;
+            int c = lhs.strval()->view().compare(rhs.strval()->view());
+            return c < 0 ? -1:1;
+        }
+        case ARRAY: {
+            ArrayObject* l = lhs.arr();
+            ArrayObject* r = rhs.arr();
+            if (l == r)
+                return 0;
+            size_t n = min(l->size(), r->size());
+            for (size_t i = 0; i < n; i++) {
+                int c = compare((*l)[i], (*r)[i]);
+                if (c != 0)
+                    return c;
             }
-            cout<<"They match!"<<endl;
-            return Object(true);
-        } break;
-        case NIL: return Object(true);
+            return l->size() < r->size() ? -1:l->size() > r->size();
+        }
+        default:
+            break;
+    }
+    return sameValue(lhs, rhs) ? 0:UNORDERED;
+}
+
+//Equal values hash the same, so an integer and the double it equals
+//share a hash: a whole double in range hashes as that integer, which
+//sameValue only matches exactly. NaN equals nothing, its hash is moot. Objects mix their fields in an order independent way to
+//match equality, which doesn't care what order the fields are in, and
+//dictionaries do the same with their entries.
+size_t hashMix(size_t seed, size_t h) {
+    return seed ^ (h + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+}
+size_t Object::hash() const {
+    if (isInteger())
+        return std::hash<int64_t>()(intval());
+    if (isNumber()) {
+        double d = numval();
+        if (d == floor(d) && d >= -9223372036854775808.0 && d < 9223372036854775808.0)
+            return std::hash<int64_t>()((int64_t)d);
+        return std::hash<double>()(d);
     }
-    return Object(false);
+    switch (type()) {
+        case BOOL: return boolval() ? 1:2;
+        case STRING: return strval()->hash();
+        case ARRAY: {
+            size_t h = 3;
+            for (const Object& m : *arr())
+                h = hashMix(h, m.hash());
+            return h;
+        }
+        case OBJECT: {
+            size_t h = 0;
+            for (auto& m : clazz()->getFields())
+                h += hashMix(std::hash<int>()(m.first), m.second.hash());
+            return hashMix(std::hash<int>()(clazz()->getTypeAtom()), h);
+        }
+        case DICT: {
+            size_t h = 4;
+            dict()->forEach([&](Object& key, Object& value) { h += hashMix(key.hash(), value.hash()); });
+            return h;
+        }
+        case ORDERED: {
+            size_t h = 5;
+            ordered()->forEach([&](Object& key, Object& value) { h = hashMix(h, hashMix(key.hash(), value.hash())); });
+            return h;
+        }
+        case FUNC: return std::hash<void*>()(func());
+        default:
+            break;
+    }
+    return 0;
+}
+
+Object gt(Object lhs, Object rhs) {
+    return Object(compare(lhs, rhs) == 1);
+}
+Object equ(Object lhs, Object rhs) {
+    return Object(sameValue(lhs, rhs));
 }
 Object lt(Object lhs, Object rhs) {
-    return gt(rhs, lhs);
+    return Object(compare(lhs, rhs) == -1);
 }
 Object lte(Object lhs, Object rhs) {
-    return lt(lhs,rhs).boolval || equ(lhs, rhs).boolval;
+    int c = compare(lhs, rhs);
+    return Object(c == -1 || c == 0);
 }
 Object gte(Object lhs, Object rhs) {
-    return gt(lhs, rhs).boolval || equ(lhs, rhs).boolval;
+    int c = compare(lhs, rhs);
+    return Object(c == 1 || c == 0);
 }
 Object neq(Object lhs, Object rhs) {
-    return equ(lhs, rhs).boolval == false;
+    return Object(!sameValue(lhs, rhs));
+}
+
+//contains on a list is a scan for an equal element
+bool listContains(ArrayObject* list, const Object& value) {
+    for (const Object& m : *list)
+        if (sameValue(m, value))
+            return true;
+    return false;
+}
+//delete on a list removes the element at an index, false if there isn't one
+bool listDelete(ArrayObject* list, const Object& index) {
+    int64_t i = index.intval();
+    if (i < 0 || i >= (int64_t)list->size())
+        return false;
+    list->erase(i);
+    return true;
+}
+//put(m, k, v) hands over k and v as a pair, so does range(m, lo, hi)
+bool checkPair(int op, const Object& arg) {
+    if (arg.type() == ARRAY && arg.arr()->size() == 2)
+        return true;
+    cout<<"Error: "<<tokenSpelling((TKSymbol)op)<<" expects two operands after the list."<<endl;
+    return false;
+}
+//put on a list stores at an index that's already there, nil if it isn't
+Object listPut(ArrayObject* list, const Object& pair) {
+    if (!checkPair(TK_PUT, pair))
+        return Object();
+    int64_t i = pair.arr()->at(0).intval();
+    if (i < 0 || i >= (int64_t)list->size())
+        return Object();
+    return list->at(i) = pair.arr()->at(1);
+}
+
+//The list operations that make sense on a dictionary, every engine runs
+//them through here: size, empty, get, put, contains, delete (true if the
+//key was there) and keys.
+Object dictOp(int op, DictObject* dict, const Object& arg) {
+    switch (op) {
+        case TK_PUT: {
+            if (!checkPair(op, arg))
+                return Object();
+            Object& slot = dict->at(arg.arr()->at(0));
+            return slot = arg.arr()->at(1);
+        }
+        case TK_SIZE:     return Object((int64_t)dict->size());
+        case TK_EMPTY:    return Object(dict->empty());
+        case TK_GET:      return dict->get(arg);
+        case TK_CONTAINS: return Object(dict->contains(arg));
+        case TK_DELETE:   return Object(dict->erase(arg));
+        case TK_KEYS:     return Object(dict->keys());
+        default:
+            cout<<"Error: "<<tokenSpelling((TKSymbol)op)<<" expects a list."<<endl;
+            break;
+    }
+    return Object();
+}
+
+//Same for an ordered map, which adds first and last (the smallest and
+//largest keys), floor, ceiling and range over [lo, hi]. Its keys come
+//back in order.
+Object orderedOp(int op, OrderedMapObject* map, const Object& arg) {
+    switch (op) {
+        case TK_SIZE:     return Object((int64_t)map->size());
+        case TK_EMPTY:    return Object(map->empty());
+        case TK_GET:      return map->get(arg);
+        case TK_PUT: {
+            if (!checkPair(op, arg))
+                return Object();
+            Object& slot = map->at(arg.arr()->at(0));
+            return slot = arg.arr()->at(1);
+        }
+        case TK_CONTAINS: return Object(map->contains(arg));
+        case TK_DELETE:   return Object(map->erase(arg));
+        case TK_KEYS:     return Object(map->keys());
+        case TK_FIRST:    return map->first();
+        case TK_LAST:     return map->last();
+        case TK_FLOOR:    return map->floor(arg);
+        case TK_CEILING:  return map->ceiling(arg);
+        case TK_RANGE:
+            if (!checkPair(op, arg))
+                return Object();
+            return Object(map->range(arg.arr()->at(0), arg.arr()->at(1)));
+        default:
+            cout<<"Error: "<<tokenSpelling((TKSymbol)op)<<" expects a list."<<endl;
+            break;
+    }
+    return Object();
 }
 
-#endif
\ No newline at end of file
+#endif
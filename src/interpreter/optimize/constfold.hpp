@@ -0,0 +1,138 @@
+#ifndef constfold_hpp
+#define constfold_hpp
+#include <cmath>
+#include <charconv>
+#include "rewriter.hpp"
+#include "../object.hpp"
+using namespace std;
+
+//Replaces operators applied to literals with the literal they evaluate
+//to. Only folds what the engines would compute the same way every time:
+//arithmetic and comparisons on numbers, concatenation and comparisons on
+//strings, and the logic operators on booleans. Numbers are folded with
+//the same helpers the engines use, so integers stay integers.
+class ConstantFolder : public AstRewriter {
+    private:
+        ConstExpr* literal(SyntaxNode* at, Token tk) {
+            Token& from = at->getToken();
+            tk.setLocation(from.sourceOffset(), from.lineNumber(), from.column());
+            return arena->make<ConstExpr>(tk);
+        }
+        //doubles get the shortest text the resolver parses back to the
+        //same value, nullptr if there's no literal for it
+        ConstExpr* number(SyntaxNode* at, Object value) {
+            if (value.isInteger())
+                return literal(at, Token(TK_INTEGER, atoms.intern(to_string(value.intval()))));
+            if (!std::isfinite(value.numval()))
+                return nullptr;
+            char text[32];
+            auto res = to_chars(text, text + sizeof(text), value.numval());
+            return literal(at, Token(TK_NUMBER, atoms.intern(string_view(text, res.ptr - text))));
+        }
+        ConstExpr* boolean(SyntaxNode* at, bool value) {
+            return literal(at, Token(value ? TK_TRUE:TK_FALSE));
+        }
+        bool isNumber(ExprNode* expr) {
+            if (!dynamic_cast<ConstExpr*>(expr))
+                return false;
+            TKSymbol sym = expr->getToken().getSymbol();
+            return sym == TK_INTEGER || sym == TK_NUMBER;
+        }
+        bool isString(ExprNode* expr) {
+            return dynamic_cast<ConstExpr*>(expr) && expr->getToken().getSymbol() == TK_STRING;
+        }
+        bool isBool(ExprNode* expr) {
+            if (!dynamic_cast<ConstExpr*>(expr))
+                return false;
+            TKSymbol sym = expr->getToken().getSymbol();
+            return sym == TK_TRUE || sym == TK_FALSE;
+        }
+        Object numberOf(ExprNode* expr) {
+            const string& text = atoms.nameOf(expr->getToken().atomId());
+            int64_t integer;
+            if (expr->getToken().getSymbol() == TK_INTEGER && integerLiteral(text, integer))
+                return Object(integer);
+            double value;
+            auto res = from_chars(text.data(), text.data() + text.size(), value);
+            return Object(res.ec == errc() ? value:stod(text));
+        }
+        ExprNode* foldNumbers(BinaryOpExpr* expr, Object lhs, Object rhs) {
+            switch (expr->getToken().getSymbol()) {
+                case TK_ADD: return number(expr, add(lhs, rhs));
+                case TK_SUB: return number(expr, sub(lhs, rhs));
+                case TK_MUL: return number(expr, mul(lhs, rhs));
+                case TK_DIV: return rhs.numval() == 0 ? nullptr:number(expr, div(lhs, rhs));
+                case TK_MOD: return rhs.numval() == 0 ? nullptr:number(expr, mod(lhs, rhs));
+                case TK_LT:  return boolean(expr, lt(lhs, rhs).boolval());
+                case TK_GT:  return boolean(expr, gt(lhs, rhs).boolval());
+                case TK_LTE: return boolean(expr, lte(lhs, rhs).boolval());
+                case TK_GTE: return boolean(expr, gte(lhs, rhs).boolval());
+                case TK_EQ:  return boolean(expr, equ(lhs, rhs).boolval());
+                case TK_NEQ: return boolean(expr, neq(lhs, rhs).boolval());
+                default:
+                    break;
+            }
+            return nullptr;
+        }
+        //string literals keep their quotes, concatenation keeps both pairs
+        ExprNode* foldStrings(BinaryOpExpr* expr, int lhs, int rhs) {
+            const string& l = atoms.nameOf(lhs);
+            const string& r = atoms.nameOf(rhs);
+            switch (expr->getToken().getSymbol()) {
+                case TK_ADD: return literal(expr, Token(TK_STRING, atoms.intern(l + r)));
+                case TK_EQ:  return boolean(expr, lhs == rhs);
+                case TK_NEQ: return boolean(expr, lhs != rhs);
+                case TK_LT:  return boolean(expr, l < r);
+                case TK_GT:  return boolean(expr, l > r);
+                case TK_LTE: return boolean(expr, l <= r);
+                case TK_GTE: return boolean(expr, l >= r);
+                default:
+                    break;
+            }
+            return nullptr;
+        }
+        ExprNode* foldBools(BinaryOpExpr* expr, bool lhs, bool rhs) {
+            switch (expr->getToken().getSymbol()) {
+                case TK_AND: return boolean(expr, lhs && rhs);
+                case TK_OR:  return boolean(expr, lhs || rhs);
+                case TK_EQ:  return boolean(expr, lhs == rhs);
+                case TK_NEQ: return boolean(expr, lhs != rhs);
+                default:
+                    break;
+            }
+            return nullptr;
+        }
+    public:
+        string name() {
+            return "constant-folding";
+        }
+        void visit(BinaryOpExpr* expr) {
+            AstRewriter::visit(expr);
+            ExprNode* lhs = expr->getLeft();
+            ExprNode* rhs = expr->getRight();
+            ExprNode* folded = nullptr;
+            if (isNumber(lhs) && isNumber(rhs)) {
+                folded = foldNumbers(expr, numberOf(lhs), numberOf(rhs));
+            } else if (isString(lhs) && isString(rhs)) {
+                folded = foldStrings(expr, lhs->getToken().atomId(), rhs->getToken().atomId());
+            } else if (isBool(lhs) && isBool(rhs)) {
+                folded = foldBools(expr, lhs->getToken().getSymbol() == TK_TRUE, rhs->getToken().getSymbol() == TK_TRUE);
+            }
+            if (folded == nullptr)
+                return;
+            REWRITTEN(expr, lhs->getToken().getString() << " " << expr->getToken().getString() << " " << rhs->getToken().getString() << " => " << folded->getToken().getString());
+            exprResult = folded;
+        }
+        void visit(UnaryOpExpr* expr) {
+            AstRewriter::visit(expr);
+            if (expr->getToken().getSymbol() != TK_SUB || !isNumber(expr->getExpr()))
+                return;
+            ExprNode* folded = number(expr, neg(numberOf(expr->getExpr())));
+            if (folded == nullptr)
+                return;
+            REWRITTEN(expr, "- " << expr->getExpr()->getToken().getString() << " => " << folded->getToken().getString());
+            exprResult = folded;
+        }
+};
+
+#endif
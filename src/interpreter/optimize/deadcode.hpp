@@ -0,0 +1,123 @@
+#ifndef deadcode_hpp
+#define deadcode_hpp
+#include <unordered_map>
+#include "rewriter.hpp"
+using namespace std;
+
+//Counts references to each name across the whole program. Scopes aren't
+//resolved yet so a name counts wherever it's used, which can only keep
+//something alive that isn't, never the other way around.
+class UseCounter : public AstRewriter {
+    public:
+        unordered_map<int, int> uses;
+        string name() {
+            return "use-counting";
+        }
+        void visit(IdExpr* expr) {
+            uses[expr->getToken().atomId()]++;
+        }
+        //the name a let declares isn't a use of it
+        void visit(LetStmt* stmt) {
+            if (BinaryOpExpr* init = dynamic_cast<BinaryOpExpr*>(stmt->getExpression()))
+                init->getRight()->accept(this);
+        }
+};
+
+//Removes lets nothing reads whose initializer can't have side effects,
+//and top level functions that are never named. Removing one can orphan
+//another so it repeats until nothing changes.
+class DeadCodeEliminator : public AstRewriter {
+    private:
+        unordered_map<int, int> uses;
+        int depth;
+        bool unused(IdExpr* name) {
+            return uses[name->getToken().atomId()] == 0;
+        }
+        bool pure(ExprNode* expr) {
+            if (expr == nullptr || dynamic_cast<ConstExpr*>(expr) || dynamic_cast<IdExpr*>(expr))
+                return true;
+            if (dynamic_cast<LambdaExpr*>(expr))
+                return true;
+            if (UnaryOpExpr* u = dynamic_cast<UnaryOpExpr*>(expr))
+                return u->getToken().getSymbol() == TK_SUB && pure(u->getExpr());
+            if (BinaryOpExpr* b = dynamic_cast<BinaryOpExpr*>(expr)) {
+                switch (b->getToken().getSymbol()) {
+                    case TK_ASSIGN: case TK_ASSIGN_SUM: case TK_ASSIGN_DIFF:
+                        return false;
+                    default:
+                        return pure(b->getLeft()) && pure(b->getRight());
+                }
+            }
+            if (ArrayConstructorExpr* a = dynamic_cast<ArrayConstructorExpr*>(expr)) {
+                for (auto e : a->getExpressions())
+                    if (!pure(e))
+                        return false;
+                return true;
+            }
+            return false;
+        }
+    public:
+        DeadCodeEliminator() : depth(0) { }
+        string name() {
+            return "dead-code";
+        }
+        bool wholeProgram() {
+            return true;
+        }
+        int run(StatementList* program, AstArena& nodes) {
+            int total = 0;
+            for (;;) {
+                UseCounter counter;
+                counter.run(program, nodes);
+                uses = counter.uses;
+                depth = 0;
+                int removed = AstRewriter::run(program, nodes);
+                total += removed;
+                if (removed == 0)
+                    break;
+            }
+            changes = total;
+            return total;
+        }
+        void visit(LetStmt* stmt) {
+            ExprNode* expr = stmt->getExpression();
+            if (IdExpr* id = dynamic_cast<IdExpr*>(expr)) {
+                if (unused(id)) {
+                    REWRITTEN(stmt, "let " << id->getToken().getString() << " is never used, removed");
+                    stmtResult = nullptr;
+                }
+                return;
+            }
+            AstRewriter::visit(stmt);
+            BinaryOpExpr* init = dynamic_cast<BinaryOpExpr*>(stmt->getExpression());
+            if (init == nullptr || init->getToken().getSymbol() != TK_ASSIGN)
+                return;
+            IdExpr* id = dynamic_cast<IdExpr*>(init->getLeft());
+            if (id != nullptr && unused(id) && pure(init->getRight())) {
+                REWRITTEN(stmt, "let " << id->getToken().getString() << " is never used, removed");
+                stmtResult = nullptr;
+            }
+        }
+        void visit(FuncDefStmt* stmt) {
+            if (depth == 0 && unused(stmt->getName())) {
+                REWRITTEN(stmt, "def " << stmt->getName()->getToken().getString() << " is never called, removed");
+                stmtResult = nullptr;
+                return;
+            }
+            depth++;
+            AstRewriter::visit(stmt);
+            depth--;
+        }
+        void visit(LambdaExpr* expr) {
+            depth++;
+            AstRewriter::visit(expr);
+            depth--;
+        }
+        void visit(BlockStmt* stmt) {
+            depth++;
+            AstRewriter::visit(stmt);
+            depth--;
+        }
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef passes_hpp
+#define passes_hpp
+#include <iostream>
+#include <vector>
+#include "rewriter.hpp"
+#include "constfold.hpp"
+#include "prune.hpp"
+#include "deadcode.hpp"
+using namespace std;
+
+//Runs a list of rewriting passes over a parsed program in order, before
+//it's resolved. -t optimizer shows each rewrite as it's made and what
+//every pass changed in total.
+class PassManager {
+    private:
+        vector<AstRewriter*> passes;
+    public:
+        PassManager() { }
+        PassManager(const PassManager&) = delete;
+        PassManager& operator=(const PassManager&) = delete;
+        ~PassManager() {
+            for (AstRewriter* pass : passes)
+                delete pass;
+        }
+        void add(AstRewriter* pass) {
+            passes.push_back(pass);
+        }
+        //a REPL line isn't the whole program, passes that need one are skipped
+        int run(StatementList* program, AstArena& arena, bool wholeProgram = true) {
+            int total = 0;
+            for (AstRewriter* pass : passes) {
+                if (pass->wholeProgram() && !wholeProgram)
+                    continue;
+                int changes = pass->run(program, arena);
+                TRACE(TRACE_OPTIMIZER, pass->name() << ": " << changes << " change" << (changes == 1 ? "":"s"));
+                total += changes;
+            }
+            return total;
+        }
+        int size() {
+            return passes.size();
+        }
+};
+
+//the pipeline for an optimization level, -O0 runs nothing
+void addStandardPasses(PassManager& pm, int level) {
+    if (level >= 1) {
+        pm.add(new ConstantFolder());
+        pm.add(new BranchPruner());
+        pm.add(new DeadCodeEliminator());
+    }
+}
+
+#endif
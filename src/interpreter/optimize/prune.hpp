@@ -0,0 +1,47 @@
+#ifndef prune_hpp
+#define prune_hpp
+#include "rewriter.hpp"
+using namespace std;
+
+//Drops the side of an if that a literal predicate never takes, and loops
+//whose predicate is literally false. Runs after folding so predicates
+//like 1 < 2 have already become literals.
+class BranchPruner : public AstRewriter {
+    private:
+        //-1 unless the predicate is the literal true or false
+        int literalTruth(ExprNode* pred) {
+            if (!dynamic_cast<ConstExpr*>(pred))
+                return -1;
+            switch (pred->getToken().getSymbol()) {
+                case TK_TRUE: return 1;
+                case TK_FALSE: return 0;
+                default:
+                    break;
+            }
+            return -1;
+        }
+    public:
+        string name() {
+            return "branch-pruning";
+        }
+        void visit(IfStmt* stmt) {
+            AstRewriter::visit(stmt);
+            int truth = literalTruth(stmt->getPredicate());
+            if (truth == 1) {
+                REWRITTEN(stmt, "if (true), kept the true branch");
+                stmtResult = stmt->getTruePath();
+            } else if (truth == 0) {
+                REWRITTEN(stmt, (stmt->getFalsePath() ? "if (false), kept the else branch":"if (false), removed"));
+                stmtResult = stmt->getFalsePath();
+            }
+        }
+        void visit(WhileStmt* stmt) {
+            AstRewriter::visit(stmt);
+            if (literalTruth(stmt->getPredicate()) == 0) {
+                REWRITTEN(stmt, "while (false), removed");
+                stmtResult = nullptr;
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef rewriter_hpp
+#define rewriter_hpp
+#include <iostream>
+#include <string>
+#include "../../parse/ast.hpp"
+#include "../../parse/arena.hpp"
+#include "../../trace.hpp"
+using namespace std;
+
+//counts a rewrite made by the pass, the description is only built when tracing
+#define REWRITTEN(node, msg) do { changes++; TRACE(TRACE_OPTIMIZER, "[" << name() << "] line " << (node)->getToken().lineNumber() << ": " << msg); } while (0)
+
+//Base for passes that rewrite the tree in place, before it's resolved.
+//Every visit walks its children and puts back whatever they came back
+//as. A pass overrides the visits it cares about and replaces the node
+//being visited by setting exprResult or stmtResult, a statement is
+//dropped by setting stmtResult to nullptr. Parameter lists and class
+//bodies are declarations, they're never walked.
+class AstRewriter : public Visitor {
+    protected:
+        AstArena* arena;
+        int changes;
+        ExprNode* exprResult;
+        StmtNode* stmtResult;
+        ExprNode* rewrite(ExprNode* expr) {
+            if (expr == nullptr)
+                return nullptr;
+            ExprNode* saved = exprResult;
+            exprResult = expr;
+            expr->accept(this);
+            ExprNode* result = exprResult;
+            exprResult = saved;
+            return result;
+        }
+        StmtNode* rewrite(StmtNode* stmt) {
+            StmtNode* saved = stmtResult;
+            stmtResult = stmt;
+            stmt->accept(this);
+            StmtNode* result = stmtResult;
+            stmtResult = saved;
+            return result;
+        }
+        void rewriteAll(NodeArray<ExprNode*>& exprs) {
+            for (auto& expr : exprs)
+                expr = rewrite(expr);
+        }
+    public:
+        AstRewriter() : arena(nullptr), changes(0), exprResult(nullptr), stmtResult(nullptr) { }
+        virtual ~AstRewriter() { }
+        virtual string name() = 0;
+        //passes that need to see every use of a name can't run on a REPL
+        //line, later lines may still refer to what this one defines
+        virtual bool wholeProgram() {
+            return false;
+        }
+        //returns how many rewrites were made
+        virtual int run(StatementList* program, AstArena& nodes) {
+            arena = &nodes;
+            changes = 0;
+            program->accept(this);
+            return changes;
+        }
+        //a dropped trailing statement leaves an empty list in its place when
+        //removing it would make an expression the function's value
+        void visit(StatementList* stmts) {
+            NodeArray<StmtNode*>& list = stmts->getList();
+            int kept = 0;
+            for (int i = 0; i < list.size(); i++) {
+                StmtNode* original = list[i];
+                StmtNode* stmt = rewrite(original);
+                if (stmt == nullptr && i == list.size() - 1 && kept > 0 && dynamic_cast<ExprStmt*>(list[kept-1]))
+                    stmt = arena->make<StatementList>(original->getToken());
+                if (stmt != nullptr)
+                    list[kept++] = stmt;
+            }
+            if (kept != list.size())
+                stmts->setStatements(NodeArray<StmtNode*>(list.begin(), kept));
+        }
+        void visit(BlockStmt* stmt) {
+            stmt->getStatements()->accept(this);
+        }
+        void visit(ExprStmt* stmt) {
+            stmt->setExpression(rewrite(stmt->getExpression()));
+        }
+        void visit(ReturnStmt* stmt) {
+            stmt->setExpression(rewrite(stmt->getExpression()));
+        }
+        void visit(LoopControlStmt* stmt) {
+
+        }
+        void visit(PrintStmt* stmt) {
+            stmt->setExpr(rewrite(stmt->getExpr()));
+        }
+        void visit(LetStmt* stmt) {
+            stmt->setExpression(rewrite(stmt->getExpression()));
+        }
+        void visit(WhileStmt* stmt) {
+            stmt->setPredicate(rewrite(stmt->getPredicate()));
+            stmt->getBody()->accept(this);
+        }
+        void visit(IfStmt* stmt) {
+            stmt->setPredicate(rewrite(stmt->getPredicate()));
+            stmt->getTruePath()->accept(this);
+            if (stmt->getFalsePath() != nullptr)
+                stmt->getFalsePath()->accept(this);
+        }
+        void visit(FuncDefStmt* stmt) {
+            stmt->getBody()->accept(this);
+        }
+        void visit(ObjectDefStmt* stmt) {
+
+        }
+        void visit(ExpressionList* exprs) {
+            rewriteAll(exprs->getExpressions());
+        }
+        void visit(UnaryOpExpr* expr) {
+            expr->setExpr(rewrite(expr->getExpr()));
+        }
+        void visit(BinaryOpExpr* expr) {
+            expr->setLeft(rewrite(expr->getLeft()));
+            expr->setRight(rewrite(expr->getRight()));
+        }
+        void visit(ConstExpr* expr) {
+
+        }
+        void visit(IdExpr* expr) {
+
+        }
+        void visit(FunctionCallExpr* expr) {
+            expr->getName()->accept(this);
+            rewriteAll(expr->getArguments()->getExpressions());
+        }
+        void visit(SubscriptExpr* expr) {
+            expr->getName()->accept(this);
+            if (expr->getToken().getSymbol() != TK_PERIOD)
+                expr->setSubscript(rewrite(expr->getSubsript()));
+        }
+        void visit(ArrayConstructorExpr* expr) {
+            rewriteAll(expr->getExpressions());
+        }
+        void visit(ListOpExpr* expr) {
+            expr->setList(rewrite(expr->getList()));
+            expr->setExpr(rewrite(expr->getExpr()));
+        }
+        void visit(LambdaExpr* expr) {
+            expr->getBody()->accept(this);
+        }
+        void visit(ObjectConstructorExpr* expr) {
+            rewriteAll(expr->getExpressions());
+        }
+};
+
+#endif
@@ -2,16 +2,28 @@
 #define prettyprint_hpp
 #include <iostream>
 #include "../parse/ast.hpp"
-#include "../util.hpp"
 using namespace std;
 
 class PrettyPrinter : public Visitor {
     private:
-        DepthTracker dt;
-        bool loud;
+        int depth;
+        void enter() {
+            depth++;
+        }
+        void leave() {
+            depth--;
+        }
+        void say(string s) {
+            for (int i = 0; i < depth; i++) cout<<" ";
+            cout<<s<<endl;
+        }
+        void enter(string s) {
+            enter();
+            say(s);
+        }
     public:
-        PrettyPrinter(bool loud = true) {
-            dt = DepthTracker(true);
+        PrettyPrinter() {
+            depth = 0;
         }
         void visit(StatementList* sl) {
             for (auto s : sl->getList()) {
@@ -19,141 +31,150 @@ class PrettyPrinter : public Visitor {
             }
         }
         void visit(BlockStmt* stmt) {
-            dt.enter();
-            dt.say("Open block scope");
+            enter();
+            say("Open block scope");
             stmt->getStatements()->accept(this);
-            dt.leave();
+            leave();
         }
         void visit(PrintStmt* stmt) {
-            dt.enter();
-            dt.say("Print");
+            enter();
+            say("Print");
             stmt->getExpr()->accept(this);
-            dt.leave();
+            leave();
         }
         void visit(WhileStmt* stmt) {
-            dt.enter();
-            dt.say("While Loop");
+            enter();
+            say("While Loop");
             stmt->getPredicate()->accept(this);
             stmt->getBody()->accept(this);
-            dt.leave();
+            leave();
         }
         void visit(IfStmt* stmt) {
-            dt.enter();
-            dt.say("If Stmt");
-            dt.say("Predicate: ");
+            enter();
+            say("If Stmt");
+            say("Predicate: ");
             stmt->getPredicate()->accept(this);
-            dt.say("True Path: ");
+            say("True Path: ");
             stmt->getTruePath()->accept(this);
             if (stmt->getFalsePath() != nullptr) {
-                dt.say("False Path: ");
+                say("False Path: ");
                 stmt->getFalsePath()->accept(this);
             }
-            dt.leave();
+            leave();
         }
         void visit(FuncDefStmt* stmt) {
-            dt.enter();
-            dt.say("Function Definition");
+            enter();
+            say("Function Definition");
             stmt->getName()->accept(this);
             stmt->getParams()->accept(this);
             stmt->getBody()->accept(this);
-            dt.leave();
+            leave();
         }
         void visit(ReturnStmt* stmt) { 
-            dt.enter();
-            dt.say("Return Statement");
+            enter();
+            say("Return Statement");
             stmt->getExpression()->accept(this);
-            dt.leave();
+            leave();
+        }
+        void visit(LoopControlStmt* stmt) {
+            enter();
+            say(stmt->getToken().getSymbol() == TK_BREAK ? "Break Statement":"Continue Statement");
+            leave();
         }
         void visit(LetStmt* stmt) {
-            dt.enter();
-            dt.say("Let Statement");
+            enter();
+            say("Let Statement");
             stmt->getExpression()->accept(this);
-            dt.leave();
+            leave();
         }
         void visit(ExprStmt* stmt) {
-            dt.enter();
-            dt.say("Expr Stmt");
+            enter();
+            say("Expr Stmt");
             stmt->getExpression()->accept(this);
-            dt.leave();
+            leave();
         } 
         void visit(LambdaExpr* expr) {
-            dt.enter();
-            dt.say("Lambda Expr");
+            enter();
+            say("Lambda Expr");
             expr->getParams()->accept(this);
             expr->getBody()->accept(this);
-            dt.leave();
+            leave();
         }
         void visit(ExpressionList* exprList) {
-            dt.enter();
+            enter();
             for (auto expr : exprList->getExpressions()) {
                 expr->accept(this);
             }
-            dt.leave();
+            leave();
         }
         void visit(SubscriptExpr* expr) {
-            dt.enter();
-            dt.say("Subscript: ");
+            enter();
+            say("Subscript: ");
             expr->getName()->accept(this);
             expr->getSubsript()->accept(this);
-            dt.leave();
+            leave();
         }
         void visit(ConstExpr* expr) {
-            dt.enter();
-            dt.say("ConstExpr " + expr->getToken().getString());
-            dt.leave();
+            enter();
+            say("ConstExpr " + expr->getToken().getString());
+            leave();
         }
         void visit(IdExpr* expr) {
-            dt.enter();
-            dt.say("IdExpr " + expr->getToken().getString() + ", " + to_string(expr->getToken().scopeLevel()));
-            dt.leave();
+            enter();
+            say("IdExpr " + expr->getToken().getString() + ", " + to_string(expr->getToken().scopeLevel()) + ":" + to_string(expr->getToken().slotIndex()));
+            leave();
         }
         void visit(BinaryOpExpr* expr) {
-            dt.enter();
-            dt.say("Binary Op " + expr->getToken().getString());
+            enter();
+            say("Binary Op " + expr->getToken().getString());
             expr->getLeft()->accept(this);
             expr->getRight()->accept(this);
-            dt.leave();
+            leave();
         }
         void visit(UnaryOpExpr* expr) {
-            dt.enter();
-            dt.say("Unary Op " + expr->getToken().getString());
+            enter();
+            say("Unary Op " + expr->getToken().getString());
             expr->getExpr()->accept(this);
-            dt.leave();
+            leave();
         }
         void visit(FunctionCallExpr* expr) {
-            dt.enter();
-            dt.say("Function call");
+            enter();
+            say("Function call");
             expr->getName()->accept(this);
             expr->getArguments()->accept(this);
-            dt.leave();
+            leave();
         }
         void visit(ArrayConstructorExpr* expr) {
-            dt.enter();
-            dt.say("Array Constructor");
+            enter();
+            switch (expr->getToken().getSymbol()) {
+                case TK_LC: say("Dictionary Constructor"); break;
+                case TK_ORDERED: say("Ordered Map Constructor"); break;
+                default: say("Array Constructor"); break;
+            }
             for (auto t : expr->getExpressions()) {
                 t->accept(this);
             }
-            dt.leave();
+            leave();
         }
         void visit(ListOpExpr* expr) {
-            dt.enter("ListOp " + expr->getToken().getString());
+            enter("ListOp " + expr->getToken().getString());
             expr->getList()->accept(this);
             if (expr->getExpr() != nullptr) expr->getExpr()->accept(this);
-            dt.leave();
+            leave();
         }
         void visit(ObjectConstructorExpr* expr) {
-            dt.enter("Object Constructor");
+            enter("Object Constructor");
             expr->getName()->accept(this);
             for (auto t : expr->getExpressions()) {
                 t->accept(this);
             }
-            dt.leave();
+            leave();
         }
         void visit(ObjectDefStmt* stmt) {
-            dt.enter("Object def");
+            enter("Object def");
             stmt->getName()->accept(this);
             stmt->getBody()->accept(this);
-            dt.leave();
+            leave();
         }
 };
 
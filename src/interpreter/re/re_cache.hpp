@@ -0,0 +1,77 @@
+#ifndef re_cache_hpp
+#define re_cache_hpp
+#include <iostream>
+#include <list>
+#include <unordered_map>
+#include "re_parser.hpp"
+#include "re_compiler.hpp"
+#include "subset_match.hpp"
+#include "../../trace.hpp"
+using namespace std;
+
+struct CompiledRegex {
+    string pattern;
+    NFAArena states;
+    NFA nfa;
+    LazyDFA* dfa;
+    CompiledRegex(string pat) : pattern(pat) {
+        REParser prs;
+        RECompiler cmp;
+        astnode* ast = prs.parse(pattern);
+        nfa = cmp.compile(ast, states);
+        delete ast;
+        dfa = new LazyDFA(states, nfa);
+    }
+    ~CompiledRegex() {
+        delete dfa;
+    }
+    bool match(const string& text) {
+        return dfa->match(text);
+    }
+};
+
+//Least recently used cache of compiled patterns keyed by their text, so a
+//match in a loop only compiles its pattern once. Evicted patterns take
+//their states with them.
+class RegexCache {
+    private:
+        size_t capacity;
+        list<CompiledRegex*> recent;
+        unordered_map<string, list<CompiledRegex*>::iterator> index;
+    public:
+        RegexCache(size_t cap = 64) : capacity(cap) { }
+        ~RegexCache() {
+            for (CompiledRegex* re : recent)
+                delete re;
+        }
+        CompiledRegex* get(const string& pattern) {
+            auto it = index.find(pattern);
+            if (it != index.end()) {
+                recent.splice(recent.begin(), recent, it->second);
+                return recent.front();
+            }
+            TRACE(TRACE_REGEX, "Compiling " << pattern);
+            if (recent.size() == capacity) {
+                CompiledRegex* old = recent.back();
+                TRACE(TRACE_REGEX, "Evicting " << old->pattern);
+                index.erase(old->pattern);
+                recent.pop_back();
+                delete old;
+            }
+            recent.push_front(new CompiledRegex(pattern));
+            index[pattern] = recent.begin();
+            return recent.front();
+        }
+        int size() {
+            return recent.size();
+        }
+};
+
+RegexCache regexCache;
+
+bool matchRegEx(string pattern, string text) {
+    TRACE(TRACE_REGEX, "Looking for " << pattern << " in " << text);
+    return regexCache.get(pattern)->match(text);
+}
+
+#endif
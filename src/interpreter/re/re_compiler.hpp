@@ -2,6 +2,7 @@
 #define re_compiler_hpp
 #include <iostream>
 #include <vector>
+#include <deque>
 #include "../../stack.hpp"
 #include "re_parser.hpp"
 using namespace std;
@@ -14,8 +15,8 @@ struct Transition {
     char ch;
     bool is_epsilon;
     NFAState* dest;
-    Transition(NFAState* d) : ch('&'), dest(d), is_epsilon(true) { }
-    Transition(char c, NFAState* d) : ch(c), dest(d), is_epsilon(false) { }
+    Transition(NFAState* d) : ch('&'), is_epsilon(true), dest(d) { }
+    Transition(char c, NFAState* d) : ch(c), is_epsilon(false), dest(d) { }
     Transition() {
         is_epsilon = false;
         dest = nullptr;
@@ -45,120 +46,113 @@ struct NFA {
     NFA(NFAState* s = nullptr, NFAState* a = nullptr) : start(s), accept(a) {  }
 };
 
-//about as simple of an allocator as you can get.
-const int MAX_STATE = 255;
-NFAState arena[MAX_STATE];
-int nf = 0;
-
-NFAState* makeState(int label) {
-    if (nf+1 == MAX_STATE) {
-        cout<<"ERROR: OUT OF MEMORY"<<endl;
-        return nullptr;
-    }
-    NFAState* ns = &arena[nf++];
-    ns->label = label;
-    return ns;
-}
-
-int nextLabel() {
-    static int label = 0;
-    return label++;
-}
-
-NFA makeAtomic(char ch) {
-    NFAState* ns = makeState(nextLabel());
-    NFAState* ts = makeState(nextLabel());
-    ns->addTransition(Transition(ch, ts));
-    return NFA(ns, ts);
-}
-
-void makeRangeClassTrans(NFAState* ns, NFAState* ts, string ccl, bool negate, int spos) {
-    char lo = ccl[spos], hi = ccl[spos+2];
-    if (!negate) {
-        for (char t = lo; t <= hi; t++)
-            ns->addTransition(Transition(t, ts));
-        return;
-    }
-    for (char t = '0'; t < lo; t++)
-        ns->addTransition(Transition(t, ts));
-    for (char t = hi+1; t <= '~'; t++)
-        ns->addTransition(Transition(t, ts));   
-}
-
-void makeRegClassTrans(NFAState* ns, NFAState* ts, string ccl, bool negate, int spos) {
-    if (!negate) {
-        ns->addTransition(Transition(ccl[spos], ts));
-        return;
-    }
-    for (char t = '0'; t <= '~'; t++) {
-        if (ccl.find(t) == std::string::npos && !ns->hasTransition(Transition(t, ts))) {
-            ns->addTransition(Transition(t, ts));
+//States for one compiled pattern. They're allocated in order and labeled
+//with their index, and are all released together when the arena is.
+class NFAArena {
+    private:
+        deque<NFAState> states;
+    public:
+        NFAState* makeState() {
+            states.emplace_back(states.size());
+            return &states.back();
         }
-   }
-}
-
-NFA makeCharClass(string ccl) {
-    NFAState* ns = makeState(nextLabel());
-    NFAState* ts = makeState(nextLabel());
-    int i = 0; bool negate = false;
-    if (ccl[0] == '^') {
-        negate = true; 
-        i++;
-    }
-    while (i < ccl.length()) {
-        if (i+2 < ccl.length() && ccl[i+1] == '-') {
-            makeRangeClassTrans(ns, ts, ccl, negate, i);
-            i += 2;
-        } else {
-            makeRegClassTrans(ns, ts, ccl, negate, i);
-            i++;
+        NFAState* at(int label) {
+            return &states[label];
         }
-    }
-    return NFA(ns, ts);
-}
-
-// "The empty string"
-NFA makeEpsilonAtomic() {
-    NFAState* ns = makeState(nextLabel());
-    NFAState* ts = makeState(nextLabel());
-    ns->addTransition(Transition(ts));
-    return NFA(ns, ts);
-}
-
-NFA makeConcat(NFA a, NFA b) {
-    a.accept->addTransition(Transition(b.start));
-    a.accept = b.accept;
-    return a;
-}
-
-NFA makeAlternate(NFA a, NFA b) {
-    NFAState* ns = makeState(nextLabel());
-    NFAState* ts = makeState(nextLabel());
-    ns->addTransition(Transition(a.start));
-    ns->addTransition(Transition(b.start));
-    a.accept->addTransition(Transition(ts));
-    b.accept->addTransition(Transition(ts));
-    return NFA(ns, ts);
-}
-
-NFA makeKleene(NFA a, bool must) {
-    NFAState* ns = makeState(nextLabel());
-    NFAState* ts = makeState(nextLabel());
-    ns->addTransition(Transition(a.start));
-    if (!must)
-        ns->addTransition(Transition(ts));
-    a.accept->addTransition(Transition(ts));
-    a.accept->addTransition(Transition(a.start));
-    return NFA(ns, ts);
-}
-
-NFA makeZeorOrOne(NFA a) {
-    return makeAlternate(a, makeEpsilonAtomic());
-}
+        int size() {
+            return states.size();
+        }
+};
 
 class RECompiler {
     private:
+        NFAArena* arena;
         InspectableStack<NFA> st;
+        NFAState* makeState() {
+            return arena->makeState();
+        }
+        NFA makeAtomic(char ch) {
+            NFAState* ns = makeState();
+            NFAState* ts = makeState();
+            ns->addTransition(Transition(ch, ts));
+            return NFA(ns, ts);
+        }
+        void makeRangeClassTrans(NFAState* ns, NFAState* ts, string ccl, bool negate, int spos) {
+            char lo = ccl[spos], hi = ccl[spos+2];
+            if (!negate) {
+                for (char t = lo; t <= hi; t++)
+                    ns->addTransition(Transition(t, ts));
+                return;
+            }
+            for (char t = '0'; t < lo; t++)
+                ns->addTransition(Transition(t, ts));
+            for (char t = hi+1; t <= '~'; t++)
+                ns->addTransition(Transition(t, ts));   
+        }
+        void makeRegClassTrans(NFAState* ns, NFAState* ts, string ccl, bool negate, int spos) {
+            if (!negate) {
+                ns->addTransition(Transition(ccl[spos], ts));
+                return;
+            }
+            for (char t = '0'; t <= '~'; t++) {
+                if (ccl.find(t) == std::string::npos && !ns->hasTransition(Transition(t, ts))) {
+                    ns->addTransition(Transition(t, ts));
+                }
+           }
+        }
+        NFA makeCharClass(string ccl) {
+            NFAState* ns = makeState();
+            NFAState* ts = makeState();
+            size_t i = 0; bool negate = false;
+            if (ccl[0] == '^') {
+                negate = true; 
+                i++;
+            }
+            while (i < ccl.length()) {
+                if (i+2 < ccl.length() && ccl[i+1] == '-') {
+                    makeRangeClassTrans(ns, ts, ccl, negate, i);
+                    i += 2;
+                } else {
+                    makeRegClassTrans(ns, ts, ccl, negate, i);
+                    i++;
+                }
+            }
+            return NFA(ns, ts);
+        }
+        // "The empty string"
+        NFA makeEpsilonAtomic() {
+            NFAState* ns = makeState();
+            NFAState* ts = makeState();
+            ns->addTransition(Transition(ts));
+            return NFA(ns, ts);
+        }
+        NFA makeConcat(NFA a, NFA b) {
+            a.accept->addTransition(Transition(b.start));
+            a.accept = b.accept;
+            return a;
+        }
+        NFA makeAlternate(NFA a, NFA b) {
+            NFAState* ns = makeState();
+            NFAState* ts = makeState();
+            ns->addTransition(Transition(a.start));
+            ns->addTransition(Transition(b.start));
+            a.accept->addTransition(Transition(ts));
+            b.accept->addTransition(Transition(ts));
+            return NFA(ns, ts);
+        }
+        NFA makeKleene(NFA a, bool must) {
+            NFAState* ns = makeState();
+            NFAState* ts = makeState();
+            ns->addTransition(Transition(a.start));
+            if (!must)
+                ns->addTransition(Transition(ts));
+            a.accept->addTransition(Transition(ts));
+            a.accept->addTransition(Transition(a.start));
+            return NFA(ns, ts);
+        }
+        NFA makeZeorOrOne(NFA a) {
+            return makeAlternate(a, makeEpsilonAtomic());
+        }
         void trav(astnode* node) {
             if (node != nullptr) {
                 if (node->type == LITERAL) {
@@ -196,6 +190,12 @@ class RECompiler {
                             NFA lhs = st.pop();
                             st.push(makeZeorOrOne(lhs));
                         } break;
+                        //matches are always against the whole text,
+                        //so anchors only wrap what they anchor
+                        case '^':
+                        case '$':
+                            trav(node->left);
+                            break;
                         default:
                             break;
                     }
@@ -203,11 +203,14 @@ class RECompiler {
             }
         }
     public:
-        RECompiler() {
+        RECompiler() : arena(nullptr) {
 
         }
-        NFA compile(astnode* node) {
+        NFA compile(astnode* node, NFAArena& states) {
+            arena = &states;
             trav(node);
+            if (st.empty())
+                return makeEpsilonAtomic();
             return st.pop();
         }
 };
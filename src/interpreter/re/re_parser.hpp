@@ -13,6 +13,10 @@ struct astnode {
     astnode* right;
     astnode(string cl, int t) : type(t), c('['), ccl(cl), left(nullptr), right(nullptr) { }
     astnode(char ch, int t) : type(t), c(ch), ccl(""), left(nullptr), right(nullptr) { }
+    ~astnode() {
+        delete left;
+        delete right;
+    }
 };
 
 void print(astnode* t, int d) {
@@ -34,7 +38,7 @@ class REParser {
         string rexpr;
         int pos;
         void advance() {
-            if (pos < rexpr.length())
+            if ((size_t)pos < rexpr.length())
                 pos++;
         }
         bool match(char c) {
@@ -48,7 +52,7 @@ class REParser {
             return rexpr[pos];
         }
         astnode* factor() {
-            astnode* t;
+            astnode* t = nullptr;
             if (lookahead() == '(') {
                 match('(');
                 t = anchordexprs();
@@ -59,7 +63,7 @@ class REParser {
             } else if (lookahead() == '[') {
                 advance();
                 string ccl;
-                while (pos+1 < rexpr.length() && lookahead() != ']') {
+                while ((size_t)pos+1 < rexpr.length() && lookahead() != ']') {
                     ccl.push_back(lookahead());
                     advance();
                 }
@@ -1,50 +1,126 @@
 #ifndef subset_match_hpp
 #define subset_match_hpp
 #include <iostream>
+#include <map>
+#include <algorithm>
+#include <deque>
+#include <vector>
 #include "re_compiler.hpp"
-#include <set>
 using namespace std;
 
-set<NFAState*> move(char ch, set<NFAState*> states) {
-    set<NFAState*> next;
-    for (NFAState* state : states) {
-        for (Transition t : state->transitions) {
-            if (t.ch == ch || t.ch == '.') {
-                if (!t.is_epsilon && next.find(t.dest) == next.end()) {
-                    next.insert(t.dest);
+//a set of NFA states as their sorted labels
+typedef vector<int> StateSet;
+
+//Subset construction done lazily: every distinct set of NFA states the
+//matcher reaches is interned once as a DFA state, and its transitions are
+//filled in the first time each byte is seen from it. Past maxStates no new
+//states are built and the rest of that match is simulated on the NFA.
+class LazyDFA {
+    private:
+        static const int UNKNOWN = -1;
+        struct DFAState {
+            StateSet nfaStates;
+            bool accepting;
+            int next[256];
+            DFAState(StateSet& ss, bool acc) : nfaStates(ss), accepting(acc) {
+                for (int i = 0; i < 256; i++)
+                    next[i] = UNKNOWN;
+            }
+        };
+        NFAArena* arena;
+        NFA nfa;
+        size_t maxStates;
+        deque<DFAState> states;
+        map<StateSet, int> interned;
+        vector<char> seen;
+        int start;
+        int dead;
+        StateSet closure(StateSet& from) {
+            StateSet result;
+            vector<int> work(from.begin(), from.end());
+            for (int label : from)
+                seen[label] = 1;
+            while (!work.empty()) {
+                int label = work.back();
+                work.pop_back();
+                result.push_back(label);
+                for (Transition& t : arena->at(label)->transitions) {
+                    if (t.is_epsilon && !seen[t.dest->label]) {
+                        seen[t.dest->label] = 1;
+                        work.push_back(t.dest->label);
+                    }
                 }
             }
+            for (int label : result)
+                seen[label] = 0;
+            sort(result.begin(), result.end());
+            return result;
         }
-    }
-    return next;
-}
-
-set<NFAState*> e_closure(set<NFAState*> states) {
-    set<NFAState*> next = states;
-    InspectableStack<NFAState*> st;
-    for (auto s : states) {
-        st.push(s);
-    }
-    while (!st.empty()) {
-        NFAState* curr = st.pop();
-        for (auto t : curr->transitions) {
-            if (t.is_epsilon && next.find(t.dest) == next.end()) {
-                next.insert(t.dest);
-                st.push(t.dest);
+        StateSet step(StateSet& from, unsigned char ch) {
+            StateSet next;
+            for (int label : from) {
+                for (Transition& t : arena->at(label)->transitions) {
+                    if (!t.is_epsilon && ((unsigned char)t.ch == ch || t.ch == '.') && !seen[t.dest->label]) {
+                        seen[t.dest->label] = 1;
+                        next.push_back(t.dest->label);
+                    }
+                }
             }
+            for (int label : next)
+                seen[label] = 0;
+            return closure(next);
         }
-    }
-    return next;
-}
-
-bool match(NFA& nfa, string text) {
-    set<NFAState*> states = {nfa.start};
-    states = e_closure(states);
-    char c;
-    for (int i = 0; (c = text[i]) != '\0'; i++) {
-        states = e_closure(move(c, states));
-    }
-    return states.find(nfa.accept) != states.end();
-}
+        bool accepts(StateSet& ss) {
+            return binary_search(ss.begin(), ss.end(), nfa.accept->label);
+        }
+        //UNKNOWN once the cap is reached and ss isn't already a state
+        int intern(StateSet& ss) {
+            auto it = interned.find(ss);
+            if (it != interned.end())
+                return it->second;
+            if (states.size() >= maxStates)
+                return UNKNOWN;
+            states.push_back(DFAState(ss, accepts(ss)));
+            interned[ss] = states.size() - 1;
+            return states.size() - 1;
+        }
+        bool simulate(StateSet current, const string& text, size_t pos) {
+            for (; pos < text.size() && text[pos] != '\0'; pos++) {
+                current = step(current, text[pos]);
+                if (current.empty())
+                    return false;
+            }
+            return accepts(current);
+        }
+    public:
+        LazyDFA(NFAArena& states, NFA& n, size_t cap = 256) : arena(&states), nfa(n), maxStates(cap), seen(states.size(), 0) {
+            StateSet none;
+            StateSet first = { nfa.start->label };
+            first = closure(first);
+            start = intern(first);
+            dead = intern(none);
+        }
+        bool match(const string& text) {
+            int curr = start;
+            for (size_t i = 0; i < text.size() && text[i] != '\0'; i++) {
+                unsigned char ch = text[i];
+                int next = states[curr].next[ch];
+                if (next == UNKNOWN) {
+                    StateSet ss = step(states[curr].nfaStates, ch);
+                    next = intern(ss);
+                    if (next == UNKNOWN)
+                        return simulate(ss, text, i+1);
+                    states[curr].next[ch] = next;
+                }
+                if (next == dead)
+                    return false;
+                curr = next;
+            }
+            return states[curr].accepting;
+        }
+        int size() {
+            return states.size();
+        }
+};
 
-#endif
\ No newline at end of file
+#endif
@@ -6,153 +6,197 @@
 #include "../parse/ast.hpp"
 #include "../buffer.hpp"
 #include "../stack.hpp"
+#include "../trace.hpp"
+#include "constants.hpp"
 using namespace std;
 
+//each binding is assigned a slot in the frame of the scope that declares it,
+//globals get slots in a table that persists for the life of the resolver.
+struct Binding {
+    int slot;
+    bool defined;
+    Binding(int s = -1, bool d = false) : slot(s), defined(d) { }
+};
+
 class ScopeResolver : public Visitor {
     private:
-    bool loud;
-        DepthTracker dt;
-        InspectableStack<unordered_map<string, bool>> defs;
+        InspectableStack<unordered_map<int, Binding>> defs;
+        unordered_map<int, int> globals;
+        ConstantPool* constants;
+        int functionDepth;
         void openScope() {
-            dt.say("Opening Scope");
-            defs.push(unordered_map<string,bool>());
+            TRACE(TRACE_RESOLVER, "Opening Scope");
+            defs.push(unordered_map<int,Binding>());
         }
-        void closeScope() {
+        int closeScope() {
+            int frameSize = defs.top().size();
             defs.pop();
-            dt.say("Scope closed.");
+            TRACE(TRACE_RESOLVER, "Scope closed.");
+            return frameSize;
         }
-        void declareVarName(string name) {
+        int globalSlot(int name) {
+            auto it = globals.find(name);
+            if (it != globals.end())
+                return it->second;
+            int slot = globals.size();
+            globals[name] = slot;
+            return slot;
+        }
+        void declareVarName(int name) {
             if (defs.empty()) {
-                dt.say("In global scope");
+                TRACE(TRACE_RESOLVER, "In global scope");
+                globalSlot(name);
                 return;
             }
             if (defs.top().find(name) != defs.top().end()) {
-                dt.say(name + " already defined");
+                TRACE(TRACE_RESOLVER, atoms.nameOf(name) + " already defined");
                 return;
             }
-            defs.top()[name] = false;
+            defs.top()[name] = Binding(defs.top().size());
         }
-        void defineVarName(string name) {
+        void defineVarName(int name) {
             if (defs.empty()) {
-                dt.say("In global scope.");
+                TRACE(TRACE_RESOLVER, "In global scope.");
                 return;
             }
-            defs.top()[name] = true;
+            defs.top()[name].defined = true;
         }
-        void resolveVariableDepth(IdExpr* node, string name) {
-            if (defs.empty()) {
-                dt.say("In global scope");
+        //a call is in tail position when it's returned directly, or when
+        //it's the trailing expression that becomes the function's value
+        void markTailCall(ExprNode* expr) {
+            if (functionDepth == 0)
                 return;
+            if (FunctionCallExpr* call = dynamic_cast<FunctionCallExpr*>(expr)) {
+                TRACE(TRACE_RESOLVER, "Tail call to " + call->getName()->getToken().getString());
+                call->setTailCall(true);
             }
+        }
+        void markTrailingCall(StatementList* body) {
+            if (body->getList().empty())
+                return;
+            if (ExprStmt* last = dynamic_cast<ExprStmt*>(body->getList().back()))
+                markTailCall(last->getExpression());
+        }
+        void resolveVariableDepth(IdExpr* node, int name) {
             for (int i = defs.size()-1; i >= 0; i--) {
-                if (defs.get(i).find(name) != defs.get(i).end()) {
+                auto it = defs.get(i).find(name);
+                if (it != defs.get(i).end()) {
                     node->getToken().setScopeLevel(defs.size() - 1 - i);
-                    dt.say(name + " resolved at scope " + to_string(node->getToken().scopeLevel()));
+                    node->getToken().setSlotIndex(it->second.slot);
+                    TRACE(TRACE_RESOLVER, node->getToken().getString() + " resolved at scope " + to_string(node->getToken().scopeLevel()) + ", slot " + to_string(node->getToken().slotIndex()));
                     return;
                 }
             }
-            dt.say("Nah man, couldnt find " + name);
+            node->getToken().setScopeLevel(-1);
+            node->getToken().setSlotIndex(globalSlot(name));
+            TRACE(TRACE_RESOLVER, node->getToken().getString() + " resolved as global, slot " + to_string(node->getToken().slotIndex()));
         }
     public:
-        ScopeResolver(bool trace = false) {
-            loud = trace;
-            dt = DepthTracker(loud);
+        ScopeResolver(ConstantPool* pool) {
+            constants = pool;
+            functionDepth = 0;
         }
         void visit(IdExpr* expr) {
-            dt.enter();
-            dt.say("Resolving Id expression for " + expr->getToken().getString());
-            resolveVariableDepth(expr, expr->getToken().getString());
-            dt.leave();
+            TRACE_ENTER(TRACE_RESOLVER, "Resolving Id expression for " + expr->getToken().getString());
+            resolveVariableDepth(expr, expr->getToken().atomId());
+            TRACE_LEAVE(TRACE_RESOLVER);
         }
         void visit(FunctionCallExpr* expr) {
-            dt.enter();
-            dt.say("Resolving function call from " + expr->getName()->getToken().getString());
+            TRACE_ENTER(TRACE_RESOLVER, "Resolving function call from " + expr->getName()->getToken().getString());
             //resolveVariableDepth(expr->getName(), expr->getName()->getToken().getString());
             expr->getName()->accept(this);
             expr->getArguments()->accept(this);
-            dt.leave();
+            TRACE_LEAVE(TRACE_RESOLVER);
         }
         void visit(BinaryOpExpr* expr) {
-            dt.enter();
-            dt.say("Resolving Binary Operator: " + expr->getToken().getString());
+            TRACE_ENTER(TRACE_RESOLVER, "Resolving Binary Operator: " + expr->getToken().getString());
             expr->getLeft()->accept(this);
             expr->getRight()->accept(this);
-            dt.leave();
+            TRACE_LEAVE(TRACE_RESOLVER);
         }
         void visit(FuncDefStmt* stmt) {
-            dt.enter();
-            string name = stmt->getName()->getToken().getString();
-            dt.say("Resolving function definition " + name);
+            int name = stmt->getName()->getToken().atomId();
+            TRACE_ENTER(TRACE_RESOLVER, "Resolving function definition " + stmt->getName()->getToken().getString());
             declareVarName(name);
             defineVarName(name);
             stmt->getName()->accept(this); 
             openScope();
+            functionDepth++;
             stmt->getParams()->accept(this);
             stmt->getBody()->accept(this);
-            closeScope();
-            dt.leave();
+            markTrailingCall(stmt->getBody());
+            functionDepth--;
+            stmt->setFrameSize(closeScope());
+            TRACE_LEAVE(TRACE_RESOLVER);
         }
         void visit(LambdaExpr* expr) {
-            dt.enter("Resolving Lambda Expr");
+            TRACE_ENTER(TRACE_RESOLVER, "Resolving Lambda Expr");
             openScope();
+            functionDepth++;
             expr->getParams()->accept(this);
             expr->getBody()->accept(this);
-            closeScope();
-            dt.leave();
+            markTrailingCall(expr->getBody());
+            functionDepth--;
+            expr->setFrameSize(closeScope());
+            TRACE_LEAVE(TRACE_RESOLVER);
         }
         void visit(BlockStmt* stmt) {
-            dt.enter("Resolving block stmt");
+            TRACE_ENTER(TRACE_RESOLVER, "Resolving block stmt");
             openScope();
             stmt->getStatements()->accept(this);
-            closeScope();
-            dt.leave();
+            stmt->setFrameSize(closeScope());
+            TRACE_LEAVE(TRACE_RESOLVER);
         }
         void visit(StatementList* stmt) {
-            dt.enter("Resolving statement list");
+            TRACE_ENTER(TRACE_RESOLVER, "Resolving statement list");
             for (auto t : stmt->getList()) {
                 t->accept(this);
             }
-            dt.leave();
+            TRACE_LEAVE(TRACE_RESOLVER);
         }
         void visit(LetStmt* stmt) {
-            dt.enter("Resolving Let stmt");
+            TRACE_ENTER(TRACE_RESOLVER, "Resolving Let stmt");
             if (stmt->getExpression()->getToken().getSymbol() == TK_ID) {
-                declareVarName(stmt->getExpression()->getToken().getString());
+                declareVarName(stmt->getExpression()->getToken().atomId());
                 stmt->getExpression()->accept(this);
-                defineVarName(stmt->getExpression()->getToken().getString());
+                defineVarName(stmt->getExpression()->getToken().atomId());
             } else if (stmt->getExpression()->getToken().getSymbol() == TK_ASSIGN) {
                 BinaryOpExpr* expr = (BinaryOpExpr*)stmt->getExpression();
-                declareVarName(expr->getLeft()->getToken().getString());
+                declareVarName(expr->getLeft()->getToken().atomId());
                 stmt->getExpression()->accept(this);
-                declareVarName(expr->getLeft()->getToken().getString());
+                defineVarName(expr->getLeft()->getToken().atomId());
             }
-            dt.leave();
+            TRACE_LEAVE(TRACE_RESOLVER);
         }
         void visit(PrintStmt* stmt) {
-            dt.enter("Resolving Print stmt");
+            TRACE_ENTER(TRACE_RESOLVER, "Resolving Print stmt");
             stmt->getExpr()->accept(this); 
-            dt.leave();
+            TRACE_LEAVE(TRACE_RESOLVER);
         }
         void visit(ExprStmt* stmt) { stmt->getExpression()->accept(this); }
         void visit(WhileStmt* stmt) {
-            dt.enter("Resolving While stmt"); 
+            TRACE_ENTER(TRACE_RESOLVER, "Resolving While stmt"); 
             stmt->getPredicate()->accept(this); 
             stmt->getBody()->accept(this);
-            dt.leave(); 
+            TRACE_LEAVE(TRACE_RESOLVER); 
         }
         void visit(IfStmt* stmt) { 
-            dt.enter("Resolving If Statement");
-            dt.say("Predicate: ");
+            TRACE_ENTER(TRACE_RESOLVER, "Resolving If Statement");
+            TRACE(TRACE_RESOLVER, "Predicate: ");
             stmt->getPredicate()->accept(this);
-            dt.say("True branch: ");
+            TRACE(TRACE_RESOLVER, "True branch: ");
             stmt->getTruePath()->accept(this);
             if (stmt->getFalsePath() != nullptr) {
-                dt.say("False branch: ");
+                TRACE(TRACE_RESOLVER, "False branch: ");
                 stmt->getFalsePath()->accept(this);
             }
-            dt.leave();
+            TRACE_LEAVE(TRACE_RESOLVER);
         }
-        void visit(ReturnStmt* stmt) { stmt->getExpression()->accept(this); }
+        void visit(ReturnStmt* stmt) {
+            stmt->getExpression()->accept(this);
+            markTailCall(stmt->getExpression());
+        }
+        void visit(LoopControlStmt* stmt) { }
         void visit(ExpressionList* expr) { 
             for (auto t : expr->getExpressions()) {
                 t->accept(this);
@@ -160,7 +204,9 @@ class ScopeResolver : public Visitor {
         }
         void visit(SubscriptExpr* expr) {
             expr->getName()->accept(this);
-            expr->getSubsript()->accept(this);
+            //member names are looked up on the object, not in scope
+            if (expr->getToken().getSymbol() != TK_PERIOD)
+                expr->getSubsript()->accept(this);
         }
         void visit(ArrayConstructorExpr* expr) {
             for (auto t : expr->getExpressions()) {
@@ -168,36 +214,44 @@ class ScopeResolver : public Visitor {
             }
          }
          void visit(ListOpExpr* expr) {
-            dt.enter("Resolving ListOp " + expr->getToken().getString());
+            TRACE_ENTER(TRACE_RESOLVER, "Resolving ListOp " + expr->getToken().getString());
             expr->getList()->accept(this);
             if (expr->getExpr() != nullptr) expr->getExpr()->accept(this);
-            dt.leave();
+            TRACE_LEAVE(TRACE_RESOLVER);
         }
          void visit(ConstExpr* expr) {
-
+            Token& tk = expr->getToken();
+            int64_t value;
+            if (tk.getSymbol() == TK_INTEGER && integerLiteral(tk.getString(), value)) {
+                expr->setConstant(constants->addInteger(value));
+            } else if (tk.getSymbol() == TK_INTEGER || tk.getSymbol() == TK_NUMBER) {
+                expr->setConstant(constants->addNumber(stod(tk.getString())));
+            } else if (tk.getSymbol() == TK_STRING) {
+                expr->setConstant(constants->addString(tk.atomId()));
+            }
          }
          void visit(UnaryOpExpr* expr) {
             expr->getExpr()->accept(this);
          }
          void visit(ObjectConstructorExpr* expr) {
-            dt.enter("Object Constructor");
+            TRACE_ENTER(TRACE_RESOLVER, "Object Constructor");
             expr->getName()->accept(this);
             for (auto t : expr->getExpressions()) {
                 t->accept(this);
             }
-            dt.leave();
+            TRACE_LEAVE(TRACE_RESOLVER);
         }
         void visit(ObjectDefStmt* stmt) {
-            dt.enter("Object def");
-            string name = stmt->getName()->getToken().getString();
-            dt.say("Resolving function definition " + name);
+            TRACE_ENTER(TRACE_RESOLVER, "Object def");
+            int name = stmt->getName()->getToken().atomId();
+            TRACE(TRACE_RESOLVER, "Resolving object definition " + stmt->getName()->getToken().getString());
             declareVarName(name);
             defineVarName(name);
             stmt->getName()->accept(this);
             openScope();            
             stmt->getBody()->accept(this);
             closeScope();
-            dt.leave();
+            TRACE_LEAVE(TRACE_RESOLVER);
         }
 };
 
@@ -0,0 +1,112 @@
+#ifndef bytecode_hpp
+#define bytecode_hpp
+#include <iostream>
+#include <vector>
+#include <string>
+#include "../object.hpp"
+using namespace std;
+
+enum OpCode : unsigned char {
+    OP_CONST,       // a: constant index
+    OP_NIL,
+    OP_TRUE,
+    OP_FALSE,
+    OP_POP,
+    OP_LOAD,        // a: slot, b: scope depth
+    OP_STORE,       // a: slot, b: scope depth. leaves the value on the stack
+    OP_DEFINE,      // a: slot, b: scope depth. binds nil
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+    OP_LT, OP_GT, OP_LTE, OP_GTE, OP_EQ, OP_NEQ, OP_MATCHRE,
+    OP_AND, OP_OR,
+    OP_NEG,
+    OP_INC, OP_DEC,
+    OP_JUMP,        // a: target
+    OP_JUMP_FALSE,  // a: target
+    OP_CALL,        // a: argument count
+    OP_TAIL_CALL,   // a: argument count. replaces the current frame
+    OP_RETURN,
+    OP_CLOSURE,     // a: function index
+    OP_ARRAY,       // a: element count
+    OP_DICT,        // a: key/value pair count, b: 1 for an ordered map
+    OP_INDEX,
+    OP_SET_INDEX,   // b: assignment operator
+    OP_GET_FIELD,   // a: field atom
+    OP_SET_FIELD,   // a: field atom, b: assignment operator
+    OP_NEW,         // a: type name atom
+    OP_CLASS,       // a: class index
+    OP_LISTOP,      // a: list operator, b: 1 if it takes an argument
+    OP_ENTER_BLOCK, // a: frame size
+    OP_EXIT_BLOCK,
+    OP_PRINT,
+    OP_HALT
+};
+
+const char* opNames[] = {
+    "const", "nil", "true", "false", "pop", "load", "store", "define",
+    "add", "sub", "mul", "div", "mod",
+    "lt", "gt", "lte", "gte", "eq", "neq", "matchre",
+    "and", "or", "neg", "inc", "dec", "jump", "jump_false", "call", "tail_call", "return", "closure",
+    "array", "dict", "index", "set_index", "get_field", "set_field", "new", "class",
+    "listop", "enter_block", "exit_block", "print", "halt"
+};
+
+struct Instruction {
+    OpCode op;
+    int a;
+    int b;
+    Instruction(OpCode o = OP_HALT, int x = 0, int y = 0) : op(o), a(x), b(y) { }
+};
+
+struct ClassTemplate {
+    int name;
+    vector<int> fields;
+};
+
+struct CodeObject {
+    IdExpr* name;
+    StatementList* paramList;
+    StatementList* body;
+    vector<int> params;
+    int frameSize;
+    vector<Instruction> code;
+    vector<Object> constants;
+    vector<CodeObject*> functions;
+    vector<ClassTemplate> classes;
+    CodeObject() : name(nullptr), paramList(nullptr), body(nullptr), frameSize(0) { }
+    int emit(OpCode op, int a = 0, int b = 0) {
+        code.push_back(Instruction(op, a, b));
+        return code.size() - 1;
+    }
+    //constants live as long as the code that holds them
+    int addConstant(Object obj) {
+        heap.pin(obj);
+        constants.push_back(obj);
+        return constants.size() - 1;
+    }
+    void dump(int depth = 0) {
+        string pad(depth*2, ' ');
+        cout<<pad<<"== "<<(name ? name->getToken().getString():"<main>")<<" =="<<endl;
+        for (size_t i = 0; i < code.size(); i++) {
+            Instruction& ins = code[i];
+            cout<<pad<<i<<": "<<opNames[ins.op];
+            switch (ins.op) {
+                case OP_CONST: cout<<" "<<constants[ins.a].toString(); break;
+                case OP_LOAD: case OP_STORE: case OP_DEFINE:
+                    cout<<" slot "<<ins.a<<", "<<ins.b; break;
+                case OP_GET_FIELD: case OP_SET_FIELD: case OP_NEW:
+                    cout<<" "<<atoms.nameOf(ins.a); break;
+                case OP_CLASS: cout<<" "<<atoms.nameOf(classes[ins.a].name); break;
+                case OP_JUMP: case OP_JUMP_FALSE: case OP_CALL: case OP_TAIL_CALL:
+                case OP_CLOSURE: case OP_ARRAY: case OP_DICT: case OP_ENTER_BLOCK:
+                    cout<<" "<<ins.a; break;
+                default:
+                    break;
+            }
+            cout<<endl;
+        }
+        for (auto f : functions)
+            f->dump(depth+1);
+    }
+};
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef compiler_hpp
+#define compiler_hpp
+#include <iostream>
+#include "../../parse/ast.hpp"
+#include "bytecode.hpp"
+using namespace std;
+
+//jump targets for break and continue in the innermost enclosing loop
+struct LoopLabels {
+    int top;
+    int blockDepth;
+    vector<int> breaks;
+    LoopLabels(int t = 0, int depth = 0) : top(t), blockDepth(depth) { }
+};
+
+//Lowers a resolved AST into bytecode for the VM. Every expression
+//leaves exactly one value on the stack, every statement leaves none.
+class Compiler : public Visitor {
+    private:
+        CodeObject* code;
+        vector<LoopLabels> loops;
+        int blockDepth;
+        void emitAssignOp(TKSymbol op) {
+            switch (op) {
+                case TK_ASSIGN_SUM: code->emit(OP_ADD); break;
+                case TK_ASSIGN_DIFF: code->emit(OP_SUB); break;
+                default: break;
+            }
+        }
+        void patchJump(int at) {
+            code->code[at].a = code->code.size();
+        }
+        void compileAssignment(BinaryOpExpr* expr) {
+            TKSymbol op = expr->getToken().getSymbol();
+            ExprNode* lhs = expr->getLeft();
+            if (SubscriptExpr* ss = dynamic_cast<SubscriptExpr*>(lhs)) {
+                ss->getName()->accept(this);
+                if (ss->getToken().getSymbol() == TK_PERIOD) {
+                    expr->getRight()->accept(this);
+                    code->emit(OP_SET_FIELD, ss->getSubsript()->getToken().atomId(), op);
+                } else {
+                    ss->getSubsript()->accept(this);
+                    expr->getRight()->accept(this);
+                    code->emit(OP_SET_INDEX, 0, op);
+                }
+                return;
+            }
+            int slot = lhs->getToken().slotIndex();
+            int depth = lhs->getToken().scopeLevel();
+            if (op != TK_ASSIGN)
+                code->emit(OP_LOAD, slot, depth);
+            expr->getRight()->accept(this);
+            emitAssignOp(op);
+            code->emit(OP_STORE, slot, depth);
+        }
+        CodeObject* compileFunction(IdExpr* name, StatementList* params, StatementList* body, int frameSize) {
+            CodeObject* fn = new CodeObject();
+            fn->name = name;
+            fn->paramList = params;
+            fn->body = body;
+            fn->frameSize = frameSize;
+            for (auto p : params->getList()) {
+                fn->params.push_back(((LetStmt*)p)->getExpression()->getToken().slotIndex());
+            }
+            CodeObject* enclosing = code;
+            vector<LoopLabels> enclosingLoops;
+            swap(loops, enclosingLoops);
+            int enclosingDepth = blockDepth;
+            blockDepth = 0;
+            code = fn;
+            //a trailing expression statement is the function's value
+            auto& stmts = body->getList();
+            ExprStmt* last = stmts.empty() ? nullptr:dynamic_cast<ExprStmt*>(stmts.back());
+            for (auto stmt : stmts) {
+                if (stmt == last) {
+                    last->getExpression()->accept(this);
+                    code->emit(OP_RETURN);
+                } else {
+                    stmt->accept(this);
+                }
+            }
+            if (last == nullptr) {
+                code->emit(OP_NIL);
+                code->emit(OP_RETURN);
+            }
+            code = enclosing;
+            swap(loops, enclosingLoops);
+            blockDepth = enclosingDepth;
+            code->functions.push_back(fn);
+            return fn;
+        }
+    public:
+        Compiler() {
+            code = nullptr;
+            blockDepth = 0;
+        }
+        CodeObject* compile(StatementList* program) {
+            code = new CodeObject();
+            loops.clear();
+            blockDepth = 0;
+            program->accept(this);
+            code->emit(OP_HALT);
+            return code;
+        }
+        void visit(StatementList* stmts) {
+            for (auto stmt : stmts->getList()) {
+                stmt->accept(this);
+            }
+        }
+        void visit(BlockStmt* stmt) {
+            code->emit(OP_ENTER_BLOCK, stmt->getFrameSize());
+            blockDepth++;
+            stmt->getStatements()->accept(this);
+            blockDepth--;
+            code->emit(OP_EXIT_BLOCK);
+        }
+        void visit(ExprStmt* stmt) {
+            stmt->getExpression()->accept(this);
+            code->emit(OP_POP);
+        }
+        void visit(ReturnStmt* stmt) {
+            stmt->getExpression()->accept(this);
+            code->emit(OP_RETURN);
+        }
+        //leaves any blocks opened inside the loop before jumping out of it
+        void visit(LoopControlStmt* stmt) {
+            if (loops.empty())
+                return;
+            LoopLabels& loop = loops.back();
+            for (int i = blockDepth; i > loop.blockDepth; i--)
+                code->emit(OP_EXIT_BLOCK);
+            if (stmt->getToken().getSymbol() == TK_BREAK) {
+                loop.breaks.push_back(code->emit(OP_JUMP));
+            } else {
+                code->emit(OP_JUMP, loop.top);
+            }
+        }
+        void visit(PrintStmt* stmt) {
+            stmt->getExpr()->accept(this);
+            code->emit(OP_PRINT);
+        }
+        void visit(LetStmt* stmt) {
+            Token& tk = stmt->getExpression()->getToken();
+            if (tk.getSymbol() == TK_ID) {
+                code->emit(OP_DEFINE, tk.slotIndex(), tk.scopeLevel());
+                return;
+            }
+            stmt->getExpression()->accept(this);
+            code->emit(OP_POP);
+        }
+        void visit(WhileStmt* stmt) {
+            int top = code->code.size();
+            loops.push_back(LoopLabels(top, blockDepth));
+            stmt->getPredicate()->accept(this);
+            int exit = code->emit(OP_JUMP_FALSE);
+            stmt->getBody()->accept(this);
+            code->emit(OP_JUMP, top);
+            patchJump(exit);
+            for (int at : loops.back().breaks)
+                patchJump(at);
+            loops.pop_back();
+        }
+        void visit(IfStmt* stmt) {
+            stmt->getPredicate()->accept(this);
+            int skip = code->emit(OP_JUMP_FALSE);
+            stmt->getTruePath()->accept(this);
+            if (stmt->getFalsePath() != nullptr) {
+                int end = code->emit(OP_JUMP);
+                patchJump(skip);
+                stmt->getFalsePath()->accept(this);
+                patchJump(end);
+            } else {
+                patchJump(skip);
+            }
+        }
+        void visit(FuncDefStmt* stmt) {
+            compileFunction(stmt->getName(), stmt->getParams(), stmt->getBody(), stmt->getFrameSize());
+            code->emit(OP_CLOSURE, code->functions.size() - 1);
+            Token& tk = stmt->getName()->getToken();
+            code->emit(OP_STORE, tk.slotIndex(), tk.scopeLevel());
+            code->emit(OP_POP);
+        }
+        void visit(ObjectDefStmt* stmt) {
+            ClassTemplate ct;
+            ct.name = stmt->getName()->getToken().atomId();
+            for (auto q : stmt->getBody()->getList()) {
+                ct.fields.push_back(((LetStmt*)q)->getExpression()->getToken().atomId());
+            }
+            code->classes.push_back(ct);
+            code->emit(OP_CLASS, code->classes.size() - 1);
+        }
+        void visit(ExpressionList* exprs) {
+            for (auto e : exprs->getExpressions()) {
+                e->accept(this);
+            }
+        }
+        void visit(UnaryOpExpr* expr) {
+            ExprNode* operand = expr->getExpr();
+            switch (expr->getToken().getSymbol()) {
+                case TK_SUB:
+                    operand->accept(this);
+                    code->emit(OP_NEG);
+                    break;
+                case TK_INCREMENT:
+                case TK_DECREMENT: {
+                    int slot = operand->getToken().slotIndex();
+                    int depth = operand->getToken().scopeLevel();
+                    //not an add of 1, which would concatenate onto a string
+                    code->emit(OP_LOAD, slot, depth);
+                    code->emit(expr->getToken().getSymbol() == TK_INCREMENT ? OP_INC:OP_DEC);
+                    code->emit(OP_STORE, slot, depth);
+                } break;
+                default:
+                    operand->accept(this);
+                    break;
+            }
+        }
+        void visit(BinaryOpExpr* expr) {
+            TKSymbol op = expr->getToken().getSymbol();
+            if (op == TK_ASSIGN || op == TK_ASSIGN_SUM || op == TK_ASSIGN_DIFF) {
+                compileAssignment(expr);
+                return;
+            }
+            expr->getLeft()->accept(this);
+            expr->getRight()->accept(this);
+            switch (op) {
+                case TK_ADD: code->emit(OP_ADD); break;
+                case TK_SUB: code->emit(OP_SUB); break;
+                case TK_MUL: code->emit(OP_MUL); break;
+                case TK_DIV: code->emit(OP_DIV); break;
+                case TK_MOD: code->emit(OP_MOD); break;
+                case TK_LT:  code->emit(OP_LT); break;
+                case TK_GT:  code->emit(OP_GT); break;
+                case TK_LTE: code->emit(OP_LTE); break;
+                case TK_GTE: code->emit(OP_GTE); break;
+                case TK_EQ:  code->emit(OP_EQ); break;
+                case TK_NEQ: code->emit(OP_NEQ); break;
+                case TK_MATCHRE: code->emit(OP_MATCHRE); break;
+                case TK_AND: code->emit(OP_AND); break;
+                case TK_OR:  code->emit(OP_OR); break;
+                default:
+                    code->emit(OP_POP);
+                    break;
+            }
+        }
+        void visit(ConstExpr* expr) {
+            Token& tk = expr->getToken();
+            switch (tk.getSymbol()) {
+                case TK_INTEGER: case TK_NUMBER: code->emit(OP_CONST, code->addConstant(numberLiteral(tk))); break;
+                case TK_STRING: code->emit(OP_CONST, code->addConstant(Object(internedString(tk.atomId())))); break;
+                case TK_TRUE:   code->emit(OP_TRUE); break;
+                case TK_FALSE:  code->emit(OP_FALSE); break;
+                default:
+                    code->emit(OP_NIL);
+                    break;
+            }
+        }
+        void visit(IdExpr* expr) {
+            Token& tk = expr->getToken();
+            code->emit(OP_LOAD, tk.slotIndex(), tk.scopeLevel());
+        }
+        void visit(FunctionCallExpr* expr) {
+            expr->getName()->accept(this);
+            expr->getArguments()->accept(this);
+            code->emit(expr->isTailCall() ? OP_TAIL_CALL:OP_CALL, expr->getArguments()->getExpressions().size());
+        }
+        void visit(SubscriptExpr* expr) {
+            expr->getName()->accept(this);
+            if (expr->getToken().getSymbol() == TK_PERIOD) {
+                code->emit(OP_GET_FIELD, expr->getSubsript()->getToken().atomId());
+            } else {
+                expr->getSubsript()->accept(this);
+                code->emit(OP_INDEX);
+            }
+        }
+        void visit(ArrayConstructorExpr* expr) {
+            for (auto t : expr->getExpressions()) {
+                t->accept(this);
+            }
+            TKSymbol kind = expr->getToken().getSymbol();
+            if (kind == TK_LC || kind == TK_ORDERED)
+                code->emit(OP_DICT, expr->getExpressions().size() / 2, kind == TK_ORDERED);
+            else
+                code->emit(OP_ARRAY, expr->getExpressions().size());
+        }
+        void visit(ListOpExpr* expr) {
+            expr->getList()->accept(this);
+            if (expr->getExpr() != nullptr)
+                expr->getExpr()->accept(this);
+            code->emit(OP_LISTOP, expr->getToken().getSymbol(), expr->getExpr() != nullptr);
+        }
+        void visit(LambdaExpr* expr) {
+            compileFunction(expr->getName(), expr->getParams(), expr->getBody(), expr->getFrameSize());
+            code->emit(OP_CLOSURE, code->functions.size() - 1);
+        }
+        void visit(ObjectConstructorExpr* expr) {
+            code->emit(OP_NEW, expr->getName()->getToken().atomId());
+        }
+};
+
+#endif
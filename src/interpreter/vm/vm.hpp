@@ -0,0 +1,366 @@
+#ifndef vm_hpp
+#define vm_hpp
+#include <cmath>
+#include "../context.hpp"
+#include "../../stack.hpp"
+#include "../re/re_cache.hpp"
+#include "bytecode.hpp"
+using namespace std;
+
+struct CallFrame {
+    CodeObject* code;
+    int ip;
+    Scope* caller;
+    CallFrame(CodeObject* c = nullptr, Scope* s = nullptr) : code(c), ip(0), caller(s) { }
+};
+
+//Stack machine for the bytecode produced by Compiler. Environments are
+//the same Scope chains the tree walking Interpreter uses, so closures
+//and depth resolved variable access behave identically.
+class VM : public RootSet {
+    private:
+        Context cxt;
+        InspectableStack<Object> sf;
+        InspectableStack<CallFrame> frames;
+        void discard(int n) {
+            while (n-- > 0) sf.pop();
+        }
+        bool invoke(Object callee, int argc) {
+            if (callee.type() != FUNC) {
+                cout<<"Error not a function"<<endl;
+                discard(argc);
+                return false;
+            }
+            Function* func = callee.func();
+            CodeObject* fn = func->code;
+            Scope* env = heap.make<Scope>(func->closure, cxt.getStack(), fn->frameSize);
+            int base = sf.size() - argc;
+            int params = fn->params.size();
+            int bound = argc < params ? argc:params;
+            for (int i = 0; i < bound; i++) {
+                env->slots[fn->params[i]] = sf.get(base + i);
+            }
+            if (argc != params) {
+                cout<<"Error: function call has mismatched arguments."<<endl;
+            }
+            discard(argc);
+            frames.push(CallFrame(fn, cxt.getStack()));
+            cxt.openScope(env);
+            return true;
+        }
+        //calls a function from native code, used by map and filter.
+        Object callFunction(Object callee, Object arg) {
+            sf.push(arg);
+            if (!invoke(callee, 1))
+                return Object();
+            run(frames.size() - 1);
+            return sf.pop();
+        }
+        void assignOp(int op, Object& slot, Object rhs) {
+            switch (op) {
+                case TK_ASSIGN: slot = rhs; break;
+                case TK_ASSIGN_SUM: slot = add(slot, rhs); break;
+                case TK_ASSIGN_DIFF: slot = sub(slot, rhs); break;
+            }
+        }
+        void newObject(int name) {
+            ClassObject* bt = cxt.getClassDef(name);
+            if (bt == nullptr) {
+                cout<<"Can't instantiate non-existant type: "<<atoms.nameOf(name)<<endl;
+                sf.push(Object());
+                return;
+            }
+            ClassObject* nobj = heap.make<ClassObject>();
+            nobj->typeName = name;
+            for (auto t : bt->fields) {
+                TRACE(TRACE_INTERPRETER, atoms.nameOf(name) << " inherits " << atoms.nameOf(t.first));
+                nobj->fields[t.first] = Object();
+            }
+            nobj->instantiated = true;
+            sf.push(Object(nobj));
+        }
+        void defineClass(ClassTemplate& ct) {
+            ClassObject* t = heap.make<ClassObject>();
+            t->typeName = ct.name;
+            t->instantiated = false;
+            for (auto& f : ct.fields) {
+                t->setMember(f, Object());
+            }
+            cxt.addClassDef(t->getTypeAtom(), t);
+            cout<<"'"<<t->getTypeName()<<"' defined."<<endl;
+        }
+        Object* field(Object& obj, int name) {
+            if (obj.type() != OBJECT || obj.clazz() == nullptr) {
+                cout<<"Error: "<<atoms.nameOf(name)<<" is not a member of "<<obj.toString()<<endl;
+                return nullptr;
+            }
+            ClassObject* co = obj.clazz();
+            auto it = co->fields.find(name);
+            if (it == co->fields.end()) {
+                cout<<atoms.nameOf(name)<<"? never heard of it for a  "<<co->getTypeName()<<endl;
+                return nullptr;
+            }
+            return &it->second;
+        }
+        Object* element(Object& list, Object& idx) {
+            if (list.type() == DICT)
+                return &list.dict()->at(idx);
+            if (list.type() == ORDERED)
+                return &list.ordered()->at(idx);
+            if (list.type() != ARRAY) {
+                cout<<"Error: subscript expects a list."<<endl;
+                return nullptr;
+            }
+            return &list.arr()->at(idx.intval());
+        }
+        //the list and function are still on the stack, the result joins
+        //them there while the function is applied
+        Object mapList(Object m, Object lmb, bool filter) {
+            if (lmb.type() != FUNC) {
+                cout<<"Error: "<<(filter ? "filter":"map")<<" expects a function argument"<<endl;
+                return Object();
+            }
+            ArrayObject* res = heap.make<ArrayObject>();
+            sf.push(Object(res));
+            for (size_t i = 0; i < m.arr()->size(); i++) {
+                Object t = m.arr()->at(i);
+                Object v = callFunction(lmb, t);
+                if (!filter) res->push_back(v);
+                else if (v.boolval()) res->push_back(t);
+            }
+            return sf.pop();
+        }
+        void listOp(int op, bool hasArg) {
+            Object arg = hasArg ? sf.top():Object();
+            Object m = sf.get(sf.size() - 1 - hasArg);
+            Object result;
+            if (m.type() == DICT || m.type() == ORDERED) {
+                result = m.type() == DICT ? dictOp(op, m.dict(), arg):orderedOp(op, m.ordered(), arg);
+                discard(1 + hasArg);
+                sf.push(result);
+                return;
+            }
+            if (m.type() != ARRAY) {
+                cout<<"Error: "<<tokenSpelling((TKSymbol)op)<<" expects a list."<<endl;
+                discard(1 + hasArg);
+                sf.push(result);
+                return;
+            }
+            switch (op) {
+                case TK_EMPTY: result = Object(m.arr()->empty()); break;
+                case TK_SIZE:  result = Object((int64_t)m.arr()->size()); break;
+                case TK_FIRST: result = m.arr()->at(0); break;
+                case TK_LAST:  result = m.arr()->back(); break;
+                case TK_MAP:   result = mapList(m, arg, false); break;
+                case TK_FILTER: result = mapList(m, arg, true); break;
+                case TK_POP: result = m.arr()->pop_front(); break;
+                case TK_REST: {
+                    ArrayObject* obj = heap.make<ArrayObject>();
+                    for (size_t i = 1; i < m.arr()->size(); i++)
+                        obj->push_back(m.arr()->at(i));
+                    result = Object(obj);
+                } break;
+                case TK_APPEND: m.arr()->push_back(arg); result = m; break;
+                case TK_PUSH: m.arr()->push_front(arg); result = m; break;
+                case TK_GET:  result = m.arr()->at(arg.intval()); break;
+                case TK_CONTAINS: result = Object(listContains(m.arr(), arg)); break;
+                case TK_DELETE: result = Object(listDelete(m.arr(), arg)); break;
+                case TK_PUT: result = listPut(m.arr(), arg); break;
+                default:
+                    break;
+            }
+            discard(1 + hasArg);
+            sf.push(result);
+        }
+        Object regExMatch(Object txt, Object pat) {
+            string text = txt.toString();
+            text = text.substr(1, text.length()-2);
+            string pattern = pat.toString();
+            pattern = pattern.substr(1, pattern.length()-2);
+            return Object(matchRegEx(pattern, text));
+        }
+        //executes until the frame at exitDepth returns or the program halts
+        void run(int exitDepth) {
+            CodeObject* code = frames.top().code;
+            int ip = frames.top().ip;
+            Object lhs, rhs;
+            for (;;) {
+                Instruction& ins = code->code[ip++];
+                switch (ins.op) {
+                    case OP_CONST: sf.push(code->constants[ins.a]); break;
+                    case OP_NIL:   sf.push(Object()); break;
+                    case OP_TRUE:  sf.push(Object(true)); break;
+                    case OP_FALSE: sf.push(Object(false)); break;
+                    case OP_POP:   sf.pop(); break;
+                    case OP_LOAD:  sf.push(cxt.getAt(ins.a, ins.b)); break;
+                    case OP_STORE: cxt.putAt(ins.a, sf.top(), ins.b); break;
+                    case OP_DEFINE: cxt.putAt(ins.a, Object(), ins.b); break;
+                    case OP_ADD: rhs = sf.pop(); lhs = sf.pop(); sf.push(add(lhs, rhs)); break;
+                    case OP_SUB: rhs = sf.pop(); lhs = sf.pop(); sf.push(sub(lhs, rhs)); break;
+                    case OP_MUL: rhs = sf.pop(); lhs = sf.pop(); sf.push(mul(lhs, rhs)); break;
+                    case OP_DIV: rhs = sf.pop(); lhs = sf.pop(); sf.push(div(lhs, rhs)); break;
+                    case OP_MOD: rhs = sf.pop(); lhs = sf.pop(); sf.push(mod(lhs, rhs)); break;
+                    case OP_LT:  rhs = sf.pop(); lhs = sf.pop(); sf.push(lt(lhs, rhs)); break;
+                    case OP_GT:  rhs = sf.pop(); lhs = sf.pop(); sf.push(gt(lhs, rhs)); break;
+                    case OP_LTE: rhs = sf.pop(); lhs = sf.pop(); sf.push(lte(lhs, rhs)); break;
+                    case OP_GTE: rhs = sf.pop(); lhs = sf.pop(); sf.push(gte(lhs, rhs)); break;
+                    case OP_EQ:  rhs = sf.pop(); lhs = sf.pop(); sf.push(equ(lhs, rhs)); break;
+                    case OP_NEQ: rhs = sf.pop(); lhs = sf.pop(); sf.push(neq(lhs, rhs)); break;
+                    case OP_MATCHRE: rhs = sf.pop(); lhs = sf.pop(); sf.push(regExMatch(lhs, rhs)); break;
+                    case OP_AND: rhs = sf.pop(); lhs = sf.pop(); sf.push(Object(lhs.boolval() && rhs.boolval())); break;
+                    case OP_OR:  rhs = sf.pop(); lhs = sf.pop(); sf.push(Object(lhs.boolval() || rhs.boolval())); break;
+                    case OP_NEG: sf.top() = neg(sf.top()); break;
+                    case OP_INC: sf.top() = increment(sf.top(), 1); break;
+                    case OP_DEC: sf.top() = increment(sf.top(), -1); break;
+                    case OP_JUMP:
+                        //backward jumps close loops, a good place to collect
+                        if (ins.a < ip) {
+                            frames.top().ip = ip;
+                            heap.safepoint();
+                        }
+                        ip = ins.a;
+                        break;
+                    case OP_JUMP_FALSE: if (!sf.pop().boolval()) ip = ins.a; break;
+                    case OP_CALL: {
+                        Object callee = sf.get(sf.size() - ins.a - 1);
+                        frames.top().ip = ip;
+                        if (invoke(callee, ins.a)) {
+                            sf.pop();
+                            code = frames.top().code;
+                            ip = 0;
+                            heap.safepoint();
+                        } else {
+                            sf.pop();
+                            sf.push(Object());
+                        }
+                    } break;
+                    //the callee takes over this frame and returns straight to our caller
+                    case OP_TAIL_CALL: {
+                        Object callee = sf.get(sf.size() - ins.a - 1);
+                        CallFrame done = frames.pop();
+                        cxt.openScope(done.caller);
+                        if (invoke(callee, ins.a)) {
+                            sf.pop();
+                            code = frames.top().code;
+                            ip = 0;
+                            heap.safepoint();
+                        } else {
+                            sf.pop();
+                            sf.push(Object());
+                            if (frames.size() == exitDepth)
+                                return;
+                            code = frames.top().code;
+                            ip = frames.top().ip;
+                        }
+                    } break;
+                    case OP_RETURN: {
+                        CallFrame done = frames.pop();
+                        cxt.openScope(done.caller);
+                        if (frames.size() == exitDepth)
+                            return;
+                        code = frames.top().code;
+                        ip = frames.top().ip;
+                    } break;
+                    case OP_CLOSURE: {
+                        CodeObject* fn = code->functions[ins.a];
+                        Function* func = heap.make<Function>();
+                        func->code = fn;
+                        func->name = fn->name;
+                        func->params = fn->paramList;
+                        func->body = fn->body;
+                        func->frameSize = fn->frameSize;
+                        func->closure = cxt.getStack();
+                        sf.push(Object(func));
+                    } break;
+                    case OP_ARRAY: {
+                        ArrayObject* arr = heap.make<ArrayObject>(ins.a);
+                        for (int i = ins.a - 1; i >= 0; i--)
+                            arr->at(i) = sf.pop();
+                        sf.push(Object(arr));
+                    } break;
+                    case OP_DICT: {
+                        int base = sf.size() - 2*ins.a;
+                        if (ins.b) {
+                            OrderedMapObject* map = heap.make<OrderedMapObject>();
+                            for (int i = base; i < sf.size(); i += 2)
+                                map->put(sf.get(i), sf.get(i + 1));
+                            discard(2*ins.a);
+                            sf.push(Object(map));
+                            break;
+                        }
+                        DictObject* dict = heap.make<DictObject>();
+                        for (int i = base; i < sf.size(); i += 2)
+                            dict->put(sf.get(i), sf.get(i + 1));
+                        discard(2*ins.a);
+                        sf.push(Object(dict));
+                    } break;
+                    case OP_INDEX: {
+                        rhs = sf.pop(); lhs = sf.pop();
+                        if (lhs.type() == DICT) {
+                            sf.push(lhs.dict()->get(rhs));
+                            break;
+                        }
+                        if (lhs.type() == ORDERED) {
+                            sf.push(lhs.ordered()->get(rhs));
+                            break;
+                        }
+                        Object* slot = element(lhs, rhs);
+                        sf.push(slot ? *slot:Object());
+                    } break;
+                    case OP_SET_INDEX: {
+                        Object val = sf.pop();
+                        rhs = sf.pop(); lhs = sf.pop();
+                        Object* slot = element(lhs, rhs);
+                        if (slot) assignOp(ins.b, *slot, val);
+                        sf.push(slot ? *slot:Object());
+                    } break;
+                    case OP_GET_FIELD: {
+                        lhs = sf.pop();
+                        Object* slot = field(lhs, ins.a);
+                        sf.push(slot ? *slot:Object());
+                    } break;
+                    case OP_SET_FIELD: {
+                        Object val = sf.pop();
+                        lhs = sf.pop();
+                        Object* slot = field(lhs, ins.a);
+                        if (slot) assignOp(ins.b, *slot, val);
+                        sf.push(slot ? *slot:Object());
+                    } break;
+                    case OP_NEW: newObject(ins.a); break;
+                    case OP_CLASS: defineClass(code->classes[ins.a]); break;
+                    case OP_LISTOP:
+                        frames.top().ip = ip;
+                        listOp(ins.a, ins.b);
+                        break;
+                    case OP_ENTER_BLOCK: cxt.openScope(heap.make<Scope>(cxt.getStack(), cxt.getStack(), ins.a)); break;
+                    case OP_EXIT_BLOCK: cxt.closeScope(); break;
+                    case OP_PRINT: sf.pop().print(); break;
+                    case OP_HALT:
+                        frames.pop();
+                        return;
+                }
+            }
+        }
+    public:
+        VM() {
+            heap.addRoots(this);
+        }
+        ~VM() {
+            heap.removeRoots(this);
+        }
+        void markRoots(Heap& heap) {
+            cxt.markRoots(heap);
+            for (int i = 0; i < frames.size(); i++)
+                heap.mark(frames.get(i).caller);
+            for (int i = 0; i < sf.size(); i++)
+                heap.mark(sf.get(i));
+        }
+        void execute(CodeObject* program) {
+            int base = sf.size();
+            frames.push(CallFrame(program, cxt.getStack()));
+            run(frames.size() - 1);
+            discard(sf.size() - base);
+        }
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef arena_hpp
+#define arena_hpp
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <new>
+using namespace std;
+
+//children of a node, laid out back to back in the arena
+template <class T>
+class NodeArray {
+    private:
+        T* items;
+        int count;
+    public:
+        NodeArray(T* it = nullptr, int n = 0) : items(it), count(n) { }
+        T* begin() { return items; }
+        T* end() { return items + count; }
+        int size() { return count; }
+        bool empty() { return count == 0; }
+        T& front() { return items[0]; }
+        T& back() { return items[count-1]; }
+        T& operator[](int i) { return items[i]; }
+};
+
+//Every node of a compilation unit is bump allocated from one arena so a
+//tree walk touches memory in roughly the order it was parsed, and the
+//whole tree goes away in one shot with the arena. Nothing allocated here
+//has its destructor run, so nodes must not own memory of their own.
+class AstArena {
+    private:
+        static const size_t BLOCK_SIZE = 64 * 1024;
+        vector<char*> blocks;
+        char* cursor;
+        size_t remaining;
+        size_t used;
+        void* allocate(size_t bytes) {
+            bytes = (bytes + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+            if (bytes > remaining) {
+                size_t blockSize = bytes > BLOCK_SIZE ? bytes:BLOCK_SIZE;
+                cursor = (char*)malloc(blockSize);
+                if (cursor == nullptr)
+                    throw bad_alloc();
+                blocks.push_back(cursor);
+                remaining = blockSize;
+            }
+            void* mem = cursor;
+            cursor += bytes;
+            remaining -= bytes;
+            used += bytes;
+            return mem;
+        }
+    public:
+        AstArena() : cursor(nullptr), remaining(0), used(0) { }
+        AstArena(const AstArena&) = delete;
+        AstArena& operator=(const AstArena&) = delete;
+        ~AstArena() {
+            for (char* block : blocks)
+                free(block);
+        }
+        template <class T, class... Args>
+        T* make(Args&&... args) {
+            return new (allocate(sizeof(T))) T(args...);
+        }
+        //copies children gathered while parsing into their final place
+        template <class T>
+        NodeArray<T> array(vector<T>& items) {
+            if (items.empty())
+                return NodeArray<T>();
+            T* mem = (T*)allocate(sizeof(T) * items.size());
+            for (size_t i = 0; i < items.size(); i++)
+                mem[i] = items[i];
+            return NodeArray<T>(mem, items.size());
+        }
+        size_t bytesUsed() {
+            return used;
+        }
+};
+
+#endif
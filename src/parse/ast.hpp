@@ -1,9 +1,9 @@
 #ifndef ast_hpp
 #define ast_hpp
-#include <list>
 #include <iostream>
 #include <unordered_map>
 #include "token.hpp"
+#include "arena.hpp"
 using namespace std;
 
 class BlockStmt;
@@ -15,6 +15,7 @@ class WhileStmt;
 class IfStmt;
 class FuncDefStmt;
 class ReturnStmt;
+class LoopControlStmt;
 class ObjectDefStmt;
 
 class ExpressionList;
@@ -36,6 +37,7 @@ class Visitor {
         virtual void visit(StatementList* stmtList) = 0;
         virtual void visit(ExprStmt* stmt) = 0;
         virtual void visit(ReturnStmt* stmt) = 0;
+        virtual void visit(LoopControlStmt* stmt) = 0;
         virtual void visit(PrintStmt* stmt) = 0;
         virtual void visit(LetStmt* stmt) = 0;
         virtual void visit(WhileStmt* stmt) = 0;
@@ -79,19 +81,14 @@ class StmtNode : public SyntaxNode {
 
 class StatementList : public StmtNode {
     private:
-        list<StmtNode*> statements;
+        NodeArray<StmtNode*> statements;
     public:
         StatementList(Token tk) : StmtNode(tk) { }
-        ~StatementList() {
-            for (auto t : statements) {
-                delete t;
-            }
-        }
-        list<StmtNode*>& getList() {
+        NodeArray<StmtNode*>& getList() {
             return statements;
         }
-        void addStatement(StmtNode* stmt) {
-            statements.push_back(stmt);
+        void setStatements(NodeArray<StmtNode*> stmts) {
+            statements = stmts;
         }
         void accept(Visitor* visitor) {
             visitor->visit(this);
@@ -101,15 +98,21 @@ class StatementList : public StmtNode {
 class BlockStmt : public StmtNode {
     private:
         StatementList* statements;
+        int frameSize;
     public:
-        BlockStmt(Token tk) : StmtNode(tk) { }
-        ~BlockStmt() { delete statements; }
+        BlockStmt(Token tk) : StmtNode(tk), frameSize(0) { }
         StatementList* getStatements() {
             return statements;
         }
         void setStatements(StatementList* stmt) {
             statements = stmt;
         }
+        int getFrameSize() {
+            return frameSize;
+        }
+        void setFrameSize(int size) {
+            frameSize = size;
+        }
         void accept(Visitor* visit) {
             visit->visit(this);
         }
@@ -120,7 +123,6 @@ class PrintStmt : public StmtNode {
         ExprNode* expression;
     public:
         PrintStmt(Token tk) : StmtNode(tk) { }
-        ~PrintStmt() { delete expression; }
         void setExpr(ExprNode* expr) {
             expression = expr;
         }
@@ -137,9 +139,6 @@ class ExprStmt : public StmtNode {
         ExprNode* expression;
     public:
         ExprStmt(Token tk) : StmtNode(tk) { }
-        ~ExprStmt() {
-            delete expression;
-        }
         ExprNode* getExpression() {
             return expression;
         }
@@ -156,9 +155,6 @@ class LetStmt : public StmtNode {
         ExprNode* expression;
     public:
         LetStmt(Token tk) : StmtNode(tk) { }
-        ~LetStmt() {
-            delete expression;
-        }
         ExprNode* getExpression() {
             return expression;
         }
@@ -176,10 +172,6 @@ class WhileStmt : public StmtNode {
         StatementList* loopBody;
     public:
         WhileStmt(Token tk) : StmtNode(tk) { }
-        ~WhileStmt() { 
-            delete predicate; 
-            delete loopBody;
-        }
         void setPredicate(ExprNode* expr) {
             predicate = expr;
         }
@@ -204,11 +196,6 @@ class IfStmt : public StmtNode {
         StatementList* falsePath;
     public:
         IfStmt(Token tk) : StmtNode(tk) { }
-        ~IfStmt() {
-            delete predicate;
-            delete truePath;
-            delete falsePath;
-        }
         void setPredicate(ExprNode* expr) {
             predicate = expr;
         }
@@ -237,7 +224,6 @@ class ReturnStmt : public StmtNode {
         ExprNode* expression;
     public:
         ReturnStmt(Token tk) : StmtNode(tk) { }
-        ~ReturnStmt() { delete expression; }
         void setExpression(ExprNode* expr) {
             expression = expr;
         }
@@ -249,10 +235,18 @@ class ReturnStmt : public StmtNode {
         }
 };
 
+//break or continue, told apart by the token
+class LoopControlStmt : public StmtNode {
+    public:
+        LoopControlStmt(Token tk) : StmtNode(tk) { }
+        void accept(Visitor* visitor) {
+            visitor->visit(this);
+        }
+};
+
 class IdExpr : public ExprNode {
     public:
         IdExpr(Token tk) : ExprNode(tk) { }
-        ~IdExpr() { }
         void accept(Visitor* visitor) {
             visitor->visit(this);
         }
@@ -263,13 +257,9 @@ class FuncDefStmt : public StmtNode {
         IdExpr* name;
         StatementList* params;
         StatementList* body;
+        int frameSize;
     public:
-        FuncDefStmt(Token tk) : StmtNode(tk) { }
-        ~FuncDefStmt() {
-            delete name;
-            delete params;
-            delete body;
-        }
+        FuncDefStmt(Token tk) : StmtNode(tk), frameSize(0) { }
         void accept(Visitor* visitor) {
             visitor->visit(this);
         }
@@ -291,6 +281,12 @@ class FuncDefStmt : public StmtNode {
         StatementList* getBody() {
             return body;
         }
+        int getFrameSize() {
+            return frameSize;
+        }
+        void setFrameSize(int size) {
+            frameSize = size;
+        }
 };
 
 class ObjectDefStmt : public StmtNode {  
@@ -299,10 +295,6 @@ class ObjectDefStmt : public StmtNode {
         StatementList* body;
     public:
         ObjectDefStmt(Token tk) : StmtNode(tk) { }
-        ~ObjectDefStmt() {
-            delete name;
-            delete body;
-        }
         void accept(Visitor* visitor) {
             visitor->visit(this);
         }
@@ -322,18 +314,13 @@ class ObjectDefStmt : public StmtNode {
 
 class ExpressionList : public ExprNode {
     private:
-        list<ExprNode*> exprs;
+        NodeArray<ExprNode*> exprs;
     public:
         ExpressionList(Token tk) : ExprNode(tk) { }
-        ~ExpressionList() {
-            for (auto t : exprs) {
-                delete t;
-            }
+        void setExpressions(NodeArray<ExprNode*> list) {
+            exprs = list;
         }
-        void addExpr(ExprNode* expr) {
-            exprs.push_back(expr);
-        }
-        list<ExprNode*> getExpressions() {
+        NodeArray<ExprNode*>& getExpressions() {
             return exprs;
         }
         void accept(Visitor* visitor) {
@@ -343,14 +330,14 @@ class ExpressionList : public ExprNode {
 
 class ArrayConstructorExpr : public ExprNode {
     private:
-        list<ExprNode*> exprs;
+        NodeArray<ExprNode*> exprs;
     public:
         ArrayConstructorExpr(Token tk) : ExprNode(tk) { }
-        list<ExprNode*>& getExpressions() {
+        NodeArray<ExprNode*>& getExpressions() {
             return exprs;
         }
-        void addExpr(ExprNode* expr) {
-            exprs.push_back(expr);
+        void setExpressions(NodeArray<ExprNode*> list) {
+            exprs = list;
         }
         void accept(Visitor* visit) {
             visit->visit(this);
@@ -360,7 +347,7 @@ class ArrayConstructorExpr : public ExprNode {
 class ObjectConstructorExpr : public ExprNode {
     private:
         IdExpr* name;
-        list<ExprNode*> exprs;
+        NodeArray<ExprNode*> exprs;
     public:
         ObjectConstructorExpr(Token tk) : ExprNode(tk) { }
         IdExpr* getName() {
@@ -369,11 +356,11 @@ class ObjectConstructorExpr : public ExprNode {
         void setName(IdExpr* na) {
             name = na;
         }
-        list<ExprNode*>& getExpressions() {
+        NodeArray<ExprNode*>& getExpressions() {
             return exprs;
         }
-        void addExpr(ExprNode* expr) {
-            exprs.push_back(expr);
+        void setExpressions(NodeArray<ExprNode*> list) {
+            exprs = list;
         }
         void accept(Visitor* visit) {
             visit->visit(this);
@@ -381,12 +368,21 @@ class ObjectConstructorExpr : public ExprNode {
 };
 
 class ConstExpr : public ExprNode {
+    private:
+        int constant;
     public:
-        ConstExpr(Token tk) : ExprNode(tk) { }
-        ~ConstExpr() { }
+        ConstExpr(Token tk) : ExprNode(tk), constant(-1) { }
         void accept(Visitor* visitor) {
             visitor->visit(this);
         }
+        //index into the program's constant pool, set by ScopeResolver for
+        //number and string literals, -1 otherwise
+        int getConstant() {
+            return constant;
+        }
+        void setConstant(int index) {
+            constant = index;
+        }
 };
 
 class SubscriptExpr : public ExprNode {
@@ -395,10 +391,6 @@ class SubscriptExpr : public ExprNode {
         ExprNode* subscript;
     public:
         SubscriptExpr(Token tk) : ExprNode(tk) { }
-        ~SubscriptExpr() {
-            delete name;
-            delete subscript;
-        }
         void setName(IdExpr* expr) {
             name = expr;
         }
@@ -420,11 +412,16 @@ class BinaryOpExpr : public ExprNode {
     private:
         ExprNode* leftChild;
         ExprNode* rightChild;
+        int specialization;
     public:
-        BinaryOpExpr(Token tk) : ExprNode(tk) { }
-        ~BinaryOpExpr() {
-            delete leftChild;
-            delete rightChild;
+        BinaryOpExpr(Token tk) : ExprNode(tk), specialization(0) { }
+        //what the evaluator has rewritten this node into after watching it
+        //run, 0 until it has been evaluated
+        int getSpecialization() {
+            return specialization;
+        }
+        void setSpecialization(int kind) {
+            specialization = kind;
         }
         ExprNode* getLeft() {
             return leftChild;
@@ -448,9 +445,6 @@ class UnaryOpExpr : public ExprNode {
         ExprNode* expression;
     public:
         UnaryOpExpr(Token tk) : ExprNode(tk) { }
-        ~UnaryOpExpr() {
-            delete expression;
-        }
         void setExpr(ExprNode* expr) {
             expression = expr;
         }
@@ -466,12 +460,9 @@ class FunctionCallExpr : public ExprNode {
     private:
         IdExpr* name;
         ExpressionList* arguments;
+        bool tailCall;
     public:
-        FunctionCallExpr(Token tk) : ExprNode(tk) { }
-        ~FunctionCallExpr() {
-            delete name;
-            delete arguments;
-        }
+        FunctionCallExpr(Token tk) : ExprNode(tk), tailCall(false) { }
         void accept(Visitor* visitor) {
             visitor->visit(this);
         }
@@ -487,20 +478,31 @@ class FunctionCallExpr : public ExprNode {
         void setArguments(ExpressionList* exprs) {
             arguments = exprs;
         }
+        //set by ScopeResolver when the call's value is its function's result
+        bool isTailCall() {
+            return tailCall;
+        }
+        void setTailCall(bool tc) {
+            tailCall = tc;
+        }
 };
 
 class LambdaExpr : public ExprNode {
+        IdExpr* name;
         StatementList* params;
         StatementList* body;
+        int frameSize;
     public:
-        LambdaExpr(Token tk) : ExprNode(tk) { }
-        ~LambdaExpr() {
-            delete params;
-            delete body;
-        }
+        LambdaExpr(Token tk) : ExprNode(tk), frameSize(0) { }
         void accept(Visitor* visitor) {
             visitor->visit(this);
         }
+        void setName(IdExpr* expr) {
+            name = expr;
+        }
+        IdExpr* getName() {
+            return name;
+        }
         void setParams(StatementList* exprs) {
             params = exprs;
         }
@@ -513,6 +515,12 @@ class LambdaExpr : public ExprNode {
         StatementList* getBody() {
             return body;
         }
+        int getFrameSize() {
+            return frameSize;
+        }
+        void setFrameSize(int size) {
+            frameSize = size;
+        }
 };
 
 class ListOpExpr : public ExprNode {
@@ -520,8 +528,7 @@ class ListOpExpr : public ExprNode {
         ExprNode* listExpr;
         ExprNode* expr;
     public:
-        ListOpExpr(Token tk) : ExprNode(tk) { }
-        ~ListOpExpr() { }
+        ListOpExpr(Token tk) : ExprNode(tk), listExpr(nullptr), expr(nullptr) { }
          void accept(Visitor* visitor) {
             visitor->visit(this);
         }
@@ -5,23 +5,63 @@
 #include "token.hpp"
 #include "lexer_matrix.h"
 #include "../buffer.hpp"
+#include "../trace.hpp"
 using namespace std;
 
 class Lexer {
     private:
         CharBuffer* buffer;
         bool shouldSkip(char ch);
-        Token makeLexToken(TKSymbol symbol, char* text, int length);
         Token nextToken();
     public:
         Lexer();
-        vector<Token> tokenizeInput(CharBuffer* buffer);
+        void init(CharBuffer* buffer);
+        Token next();
+};
+
+//The parser pulls tokens as it needs them rather than waiting on the
+//whole input to be lexed. Only a small window is kept: the current
+//token, the one before it, and up to WINDOW-2 tokens of lookahead.
+class TokenStream {
+    private:
+        static const int WINDOW = 4;
+        Lexer lexer;
+        Token window[WINDOW];
+        int pos;
+        int filled;
+        void fill(int upto) {
+            while (filled <= upto) {
+                window[filled % WINDOW] = lexer.next();
+                filled++;
+            }
+        }
+    public:
+        TokenStream(CharBuffer* buffer) {
+            lexer.init(buffer);
+            pos = 0;
+            filled = 0;
+        }
+        Token& current() {
+            fill(pos);
+            return window[pos % WINDOW];
+        }
+        Token& peek(int ahead) {
+            fill(pos + ahead);
+            return window[(pos + ahead) % WINDOW];
+        }
+        Token previous() {
+            return pos > 0 ? window[(pos-1) % WINDOW]:Token();
+        }
+        void advance() {
+            if (current().getSymbol() != TK_EOI)
+                pos++;
+        }
 };
 
 Lexer::Lexer() { }
 
-Token Lexer::makeLexToken(TKSymbol symbol, char* text, int length) {
-    return Token(symbol, string(text, length));
+void Lexer::init(CharBuffer* buff) {
+    buffer = buff;
 }
 
 Token Lexer::nextToken() {
@@ -29,24 +69,38 @@ Token Lexer::nextToken() {
     int last_match = 0;
     int match_len = 0;
     int len = 0;
-    bool inquote = false;
-    int start = buffer->markStart();
-    for (char p = buffer->get(); !buffer->done(); buffer->advance(), len++) {
-        cout<<state<<"("<<buffer->get()<<") -> ";
-        state = matrix[state][buffer->get()];
-        if (state > 0 && accept[state] > -1) {
+    buffer->markStart();
+    for (; !buffer->done(); buffer->advance(), len++) {
+        int next = transitions[state][byteClass[(uint8_t)buffer->get()]];
+        TRACE(TRACE_LEXER, state << "(" << buffer->get() << ") -> " << next);
+        state = next;
+        if (state == 0) {
+            break;
+        }
+        if (accept[state] > -1) {
             last_match = state;
             match_len = len;
         }
-        if (state < 1) {
-            break;
-        }
     }
-    cout<<endl;
+    //the scan reads past the longest match looking for a longer one,
+    //give back whatever it read beyond it.
+    int keep = last_match == 0 ? 0:match_len + 1;
+    for (; len > keep; len--)
+        buffer->rewind();
     if (last_match == 0) {
         return {TK_EOI};
     }
-    return Token((TKSymbol)accept[last_match], buffer->sliceFromStart(match_len));
+    TKSymbol symbol = (TKSymbol)accept[last_match];
+    Span span = buffer->spanFromStart(match_len);
+    int atom = -1;
+    //keywords with a second spelling (var, fn) keep their text too, so
+    //getString gives back what was written rather than let/def
+    if (symbol == TK_ID || symbol == TK_STRING || symbol == TK_INTEGER || symbol == TK_NUMBER
+        || buffer->view(span) != tokenSpelling(symbol))
+        atom = atoms.intern(buffer->view(span));
+    Token token(symbol, atom);
+    token.setLocation(span.offset, buffer->startLine(), buffer->startColumn());
+    return token;
 }
 
 bool Lexer::shouldSkip(char c) {
@@ -55,7 +109,6 @@ bool Lexer::shouldSkip(char c) {
 
 Token extractString(CharBuffer* buffer) {
     string str;
-    int k = 0;
     char prev = buffer->get();
     buffer->advance();
     str.push_back(prev);
@@ -68,24 +121,23 @@ Token extractString(CharBuffer* buffer) {
         str.push_back(buffer->get());
         buffer->advance();
     }
-    return Token(TK_STRING, str);
+    return Token(TK_STRING, atoms.intern(str));
 }
 
-vector<Token> Lexer::tokenizeInput(CharBuffer* buff) {
-    buffer = buff;
-    vector<Token> tokens;
-    for (; !buffer->done();) { 
+//skips anything that doesn't start a token, once the input runs out
+//every call returns TK_EOI.
+Token Lexer::next() {
+    while (!buffer->done()) {
         while (shouldSkip(buffer->get())) buffer->advance();
-        Token next;
-        next = nextToken();
-        if (next.getSymbol() != TK_EOI) {
-           // cout<<"<"<< next.getSymbol()<<", "<<next.getString()<<">\n";
-            tokens.push_back(next);
-        } else {
-            buffer->advance();
+        Token token = nextToken();
+        if (token.getSymbol() != TK_EOI) {
+            TRACE(TRACE_LEXER, "<" << token.getSymbol() << ", " << token.getString() << ">");
+            return token;
         }
+        buffer->advance();
     }
-    tokens.push_back(Token(TK_EOI, "<fin>"));
-    return tokens;
+    Token eoi(TK_EOI);
+    eoi.setLocation(buffer->markStart(), buffer->startLine(), buffer->startColumn());
+    return eoi;
 }
 #endif
\ No newline at end of file
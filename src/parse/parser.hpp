@@ -4,37 +4,34 @@
 #include <stack>
 #include <vector>
 #include "ast.hpp"
-#include "../util.hpp"
+#include "lexer.hpp"
+#include "../trace.hpp"
 using namespace std;
 
 
 class Parser {
     private:
-        DepthTracker dt;
-        Token* tokens;
-        int num_tokens;
-        int token_pos;
+        TokenStream* tokens;
+        AstArena* arena;
         bool expect(TKSymbol symbol) {
-            return symbol == tokens[token_pos].getSymbol();
+            return symbol == tokens->current().getSymbol();
         }
         bool match(TKSymbol symbol) {
             if (expect(symbol)) {
                 advance();
                 return true;
             }
-            cout<<"Mismatched Token: "<<current().getString()<<endl;
+            cout<<"Mismatched Token: "<<current().getString()<<" at line "<<current().lineNumber()<<", column "<<current().column()<<endl;
             return false;
         }
         void advance() {
-            if (tokens[token_pos].getSymbol() != TK_EOI) {
-                token_pos++;
-            }
+            tokens->advance();
         }
         Token current() {
-            return tokens[token_pos];
+            return tokens->current();
         }
         Token previous() {
-            return token_pos > 0 ? tokens[token_pos-1]:Token();
+            return tokens->previous();
         }
         bool isBinOp(TKSymbol symbol) {
             switch (symbol) {
@@ -70,11 +67,32 @@ class Parser {
             }
             return false;
         }
+        //the dictionary and ordered map operations aren't reserved. They're
+        //operations only where a call is expected, put(...) or ordered {...},
+        //anywhere else they're plain names
+        bool isContextualOp(TKSymbol symbol) {
+            switch (symbol) {
+                case TK_PUT:
+                case TK_KEYS:
+                case TK_LAST:
+                case TK_FLOOR:
+                case TK_RANGE:
+                case TK_DELETE:
+                case TK_ORDERED:
+                case TK_CEILING:
+                case TK_CONTAINS:
+                    return true;
+                default:
+                    break;
+            }
+            return false;
+        }
         bool isSeperator(TKSymbol symbol) {
             switch (symbol) {
                 case TK_LC:
                 case TK_RC:
                 case TK_SEMI:
+                case TK_COLON:
                 case TK_COMMA: return true;
                 default:
                     break;
@@ -127,7 +145,8 @@ class Parser {
             return 10;
         }
         LambdaExpr* parseLambdaExpr(int prec) {
-            LambdaExpr* node = new LambdaExpr(current());
+            LambdaExpr* node = arena->make<LambdaExpr>(current());
+            node->setName(arena->make<IdExpr>(Token(TK_DEF, atoms.intern("Lambda"))));
             match(TK_LAMBDA);
             node->setParams(parseParamList());
             match(TK_RP);
@@ -139,38 +158,66 @@ class Parser {
                 node->setBody(parseStmtList());
                 match(TK_RC);
             }
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         ObjectConstructorExpr* parseObjectConstructor(int prec) {
-            ObjectConstructorExpr* node = new ObjectConstructorExpr(current());
+            ObjectConstructorExpr* node = arena->make<ObjectConstructorExpr>(current());
             match(TK_NEW);
             node->setName((IdExpr*)parseExpression(0));
             if (expect(TK_LP)) {
                 match(TK_LP);
+                vector<ExprNode*> args;
                 while (!expect(TK_EOI) && !expect(TK_RP)) {
                     if (expect(TK_COMMA))
                         match(TK_COMMA);
-                    node->addExpr(parseExpression(0));
+                    args.push_back(parseExpression(0));
                 }
+                node->setExpressions(arena->array(args));
                 match(TK_RP);
             }
             return node;
         }
         ArrayConstructorExpr* parseArrayConstructor(int prec) {
-            ArrayConstructorExpr* node = new ArrayConstructorExpr(current());
+            ArrayConstructorExpr* node = arena->make<ArrayConstructorExpr>(current());
             match(TK_LB);
+            vector<ExprNode*> items;
             while (!expect(TK_EOI) && !expect(TK_RB)) {
                 if (expect(TK_COMMA))
                     match(TK_COMMA);
-                node->addExpr(parseExpression(0));
+                items.push_back(parseExpression(0));
             }
+            node->setExpressions(arena->array(items));
             match(TK_RB);
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
+            return node;
+        }
+        //{k: v, ...} builds a dictionary and ordered {k: v, ...} an ordered
+        //map. They share the array node, told apart by its token, with the
+        //keys and values alternating
+        ArrayConstructorExpr* parseDictConstructor(int prec) {
+            ArrayConstructorExpr* node = arena->make<ArrayConstructorExpr>(current());
+            if (expect(TK_ORDERED))
+                advance();
+            match(TK_LC);
+            vector<ExprNode*> items;
+            while (!expect(TK_EOI) && !expect(TK_RC)) {
+                if (expect(TK_COMMA))
+                    match(TK_COMMA);
+                if (expect(TK_RC))
+                    break;
+                items.push_back(parseExpression(0));
+                if (!match(TK_COLON))
+                    break;
+                items.push_back(parseExpression(0));
+            }
+            node->setExpressions(arena->array(items));
+            match(TK_RC);
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         ListOpExpr* parseListOpExpr(int prec) {
-            ListOpExpr* node = new ListOpExpr(current());
+            ListOpExpr* node = arena->make<ListOpExpr>(current());
                 match(current().getSymbol());
                 match(TK_LP);
                 node->setList(parseExpression(0));
@@ -178,106 +225,141 @@ class Parser {
                     match(TK_COMMA);
                     node->setExpr(parseExpression(0));
                 }
+                //put(d, k, v) and range(m, lo, hi) pass their last two operands
+                //as the list [k, v] or [lo, hi]
+                TKSymbol op = node->getToken().getSymbol();
+                if ((op == TK_PUT || op == TK_RANGE) && expect(TK_COMMA)) {
+                    Token bounds(TK_LB);
+                    Token& at = node->getToken();
+                    bounds.setLocation(at.sourceOffset(), at.lineNumber(), at.column());
+                    ArrayConstructorExpr* pair = arena->make<ArrayConstructorExpr>(bounds);
+                    match(TK_COMMA);
+                    vector<ExprNode*> items = { node->getExpr(), parseExpression(0) };
+                    pair->setExpressions(arena->array(items));
+                    node->setExpr(pair);
+                }
                 match(TK_RP);
                 return node;
         }
         SubscriptExpr* parseSubscript(ExprNode* lhs) {
-            SubscriptExpr* node = new SubscriptExpr(current());
+            SubscriptExpr* node = arena->make<SubscriptExpr>(current());
             node->setName((IdExpr*)lhs);
             match(TK_LB);
             node->setSubscript(parseExpression(0));
             match(TK_RB);
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         SubscriptExpr* parseObjectMember(ExprNode* lhs) {
-            SubscriptExpr* node = new SubscriptExpr(current());
+            SubscriptExpr* node = arena->make<SubscriptExpr>(current());
             node->setName((IdExpr*)lhs);
             match(TK_PERIOD);
             node->setSubscript(parseFirst(0));
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         FunctionCallExpr* parseFunctionCall(ExprNode* lhs) {
-            FunctionCallExpr* node = new FunctionCallExpr(current());
+            FunctionCallExpr* node = arena->make<FunctionCallExpr>(current());
             node->setName((IdExpr*)lhs);
             match(TK_LP);
             node->setArguments(parseExprList());
             match(TK_RP);
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         BinaryOpExpr* parseBinaryExpr(ExprNode* lhs) {
-            BinaryOpExpr* node = new BinaryOpExpr(current());
+            BinaryOpExpr* node = arena->make<BinaryOpExpr>(current());
             node->setLeft(lhs);
             int p = precedence(current().getSymbol());
             advance();
             node->setRight(parseExpression(p+10));
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         UnaryOpExpr* parsePostfixUnary(ExprNode* lhs) {
-            UnaryOpExpr* node = new UnaryOpExpr(current());
+            UnaryOpExpr* node = arena->make<UnaryOpExpr>(current());
             match(current().getSymbol());
             node->setExpr(lhs);
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         ConstExpr* parseConstExpr(int prec) {
-            ConstExpr* node =  new ConstExpr(current());
+            ConstExpr* node =  arena->make<ConstExpr>(current());
             match(current().getSymbol());
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         UnaryOpExpr* parsePrefixUnary(int prec) {
-            UnaryOpExpr* node = new UnaryOpExpr(current());
+            UnaryOpExpr* node = arena->make<UnaryOpExpr>(current());
             match(TK_SUB);
             node->setExpr(parseExpression(precedence(TK_SUB)+40));
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         ConstExpr* parseRand() {
-            ConstExpr* node =  new ConstExpr(current());
+            ConstExpr* node =  arena->make<ConstExpr>(current());
             match(current().getSymbol());
             match(TK_LP);
             match(TK_RP);
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         IdExpr* parseIdentifier() {
-            IdExpr* node = new IdExpr(current());
+            IdExpr* node = arena->make<IdExpr>(current());
             match(TK_ID);
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
+        //a name that may be spelled like a contextual operation. def keys(...)
+        //defines keys, but a call written keys(...) is still the operation
+        IdExpr* parseName() {
+            if (!isContextualOp(current().getSymbol()))
+                return parseIdentifier();
+            Token at = current();
+            Token name(TK_ID, atoms.intern(tokenSpelling(at.getSymbol())));
+            name.setLocation(at.sourceOffset(), at.lineNumber(), at.column());
+            advance();
+            TRACE_LEAVE(TRACE_PARSER);
+            return arena->make<IdExpr>(name);
+        }
+        ExprNode* parseContextualOp(int prec) {
+            TKSymbol next = tokens->peek(1).getSymbol();
+            if (expect(TK_ORDERED) && next == TK_LC)
+                return parseDictConstructor(prec);
+            if (!expect(TK_ORDERED) && next == TK_LP)
+                return parseListOpExpr(prec);
+            return parseName();
+        }
         ExpressionList* parseExprList() {
-            ExpressionList* el = new ExpressionList(current());
+            ExpressionList* el = arena->make<ExpressionList>(current());
+            vector<ExprNode*> exprs;
             while (!expect(TK_RP)) {
                 if (expect(TK_COMMA)) advance();
-                el->addExpr(parseExpression(0));
+                exprs.push_back(parseExpression(0));
             }
+            el->setExpressions(arena->array(exprs));
             return el;
         }
         PrintStmt* parsePrint() {
-            dt.enter("Parse Print Statement");
-            PrintStmt* node = new PrintStmt(current());
+            TRACE_ENTER(TRACE_PARSER, "Parse Print Statement");
+            PrintStmt* node = arena->make<PrintStmt>(current());
             match(TK_PRINTLN);
             node->setExpr(parseExpression(0));
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         LetStmt* parseLet() {
-            dt.enter("Parse Let Statement");
-            LetStmt* node = new LetStmt(current());
+            TRACE_ENTER(TRACE_PARSER, "Parse Let Statement");
+            LetStmt* node = arena->make<LetStmt>(current());
             if (expect(TK_LET))
                 match(TK_LET);
             node->setExpression(parseExpression(0));
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         WhileStmt* parseWhile() {
-            dt.enter("Parse While Statement");
-            WhileStmt* node = new WhileStmt(current());
+            TRACE_ENTER(TRACE_PARSER, "Parse While Statement");
+            WhileStmt* node = arena->make<WhileStmt>(current());
             match(TK_WHILE);
             match(TK_LP);
             node->setPredicate(parseExpression(0));
@@ -285,12 +367,12 @@ class Parser {
             match(TK_LC);
             node->setBody(parseStmtList());
             match(TK_RC);
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         IfStmt* parseIf() {
-            dt.enter("Parse If Statement");
-            IfStmt* node = new IfStmt(current());
+            TRACE_ENTER(TRACE_PARSER, "Parse If Statement");
+            IfStmt* node = arena->make<IfStmt>(current());
             match(TK_IF);
             match(TK_LP);
             node->setPredicate(parseExpression(0));
@@ -306,63 +388,72 @@ class Parser {
             } else {
                 node->setFalsePath(nullptr);
             }
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         StatementList* parseParamList() {
-            dt.enter("Parse Param List");
-            StatementList* sl = new StatementList(current());
+            TRACE_ENTER(TRACE_PARSER, "Parse Param List");
+            StatementList* sl = arena->make<StatementList>(current());
+            vector<StmtNode*> params;
             while (!expect(TK_EOI) && !expect(TK_RP)) {
-                sl->addStatement(parseLet());
+                params.push_back(parseLet());
                 if (expect(TK_COMMA)) {
                     match(TK_COMMA);
                 }
             }
-            dt.leave();
+            sl->setStatements(arena->array(params));
+            TRACE_LEAVE(TRACE_PARSER);
             return sl;
         }
         FuncDefStmt* parseFunctionDefinition() {
-            dt.enter("Parse Function Definition");
-            FuncDefStmt* node = new FuncDefStmt(current());
+            TRACE_ENTER(TRACE_PARSER, "Parse Function Definition");
+            FuncDefStmt* node = arena->make<FuncDefStmt>(current());
             advance();
-            node->setName((IdExpr*)parseFirst(0));
+            node->setName(parseName());
             match(TK_LP);
             node->setParams(parseParamList());
             match(TK_RP);
             match(TK_LC);
             node->setBody(parseStmtList());
             match(TK_RC);
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         ObjectDefStmt* parseClassDefinition() {
-            dt.enter("Parse Class Definition");
+            TRACE_ENTER(TRACE_PARSER, "Parse Class Definition");
             match(TK_CLASS);
-            ObjectDefStmt* node = new ObjectDefStmt(current());
+            ObjectDefStmt* node = arena->make<ObjectDefStmt>(current());
             node->setName((IdExpr*)parseExpression(0));
             match(TK_LC);
             node->setBody(parseStmtList());
             match(TK_RC);
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         ReturnStmt* parseReturn() {
-            dt.enter("Parse Return statement");
-            ReturnStmt* node = new ReturnStmt(current());
+            TRACE_ENTER(TRACE_PARSER, "Parse Return statement");
+            ReturnStmt* node = arena->make<ReturnStmt>(current());
             advance();
             node->setExpression(parseExpression(0));
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
+            return node;
+        }
+        LoopControlStmt* parseLoopControl() {
+            TRACE_ENTER(TRACE_PARSER, "Parse Loop control statement");
+            LoopControlStmt* node = arena->make<LoopControlStmt>(current());
+            advance();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         ExprStmt* parseExprStmt() {
-            dt.enter("Parse Expr Statement");
-            ExprStmt* node = new ExprStmt(current());
+            TRACE_ENTER(TRACE_PARSER, "Parse Expr Statement");
+            ExprStmt* node = arena->make<ExprStmt>(current());
             node->setExpression(parseExpression(0));
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         BlockStmt* parseBlock(){
-            BlockStmt* bs = new BlockStmt(current());
+            BlockStmt* bs = arena->make<BlockStmt>(current());
             match(TK_LC);
             bs->setStatements(parseStmtList());
             match(TK_RC);
@@ -370,17 +461,21 @@ class Parser {
         }
         ExprNode* parseFirst(int prec) {
             ExprNode* node = nullptr;
-            dt.enter("Parse First on " + current().getString());
+            TRACE_ENTER(TRACE_PARSER, "Parse First on " + current().getString());
             if (isListOp(current().getSymbol())) {
                 return parseListOpExpr(prec);
             }
+            if (isContextualOp(current().getSymbol())) {
+                return parseContextualOp(prec);
+            }
             switch (current().getSymbol()) {
-                case TK_NUMBER:case TK_STRING:
+                case TK_INTEGER:case TK_NUMBER:case TK_STRING:
                 case TK_NULL:
                 case TK_TRUE: case TK_FALSE: 
                                 return parseConstExpr(prec);
                 case TK_SUB:    return parsePrefixUnary(prec);
                 case TK_LB:     return parseArrayConstructor(prec);
+                case TK_LC:     return parseDictConstructor(prec);
                 case TK_NEW:    return parseObjectConstructor(prec);
                 case TK_LAMBDA: return parseLambdaExpr(prec);   
                 case TK_ID:     return parseIdentifier();
@@ -392,7 +487,7 @@ class Parser {
         }
         ExprNode* parseRest(ExprNode* lhs) {
             ExprNode* node = nullptr;
-            dt.enter("Parse rest on " + current().getSymbol());
+            TRACE_ENTER(TRACE_PARSER, "Parse rest on " + current().getString());
             if (isBinOp(current().getSymbol())) {
                 return parseBinaryExpr(lhs);
             }
@@ -403,16 +498,16 @@ class Parser {
                 case TK_INCREMENT:
                 case TK_DECREMENT: return parsePostfixUnary(lhs);
                 case TK_RB: case TK_RP: 
-                    dt.leave();
+                    TRACE_LEAVE(TRACE_PARSER);
                     return lhs;
                 default:
                     break;
             }
-            dt.leave();
+            TRACE_LEAVE(TRACE_PARSER);
             return node;
         }
         ExprNode* parseExpression(int prec) {
-            dt.enter("ParseExpression on " + current().getString());
+            TRACE_ENTER(TRACE_PARSER, "ParseExpression on " + current().getString());
             ExprNode* node = parseFirst(prec);
             while (!expect(TK_EOI) && !isSeperator(current().getSymbol()) && prec <= precedence(current().getSymbol())) {
                 if (expect(TK_RP) || expect(TK_RB))
@@ -422,8 +517,7 @@ class Parser {
             return node;
         }
         StmtNode* parseStmt() {
-            Token curr = current();
-            dt.say("Parse Statement on " + curr.getString());
+            TRACE(TRACE_PARSER, "Parse Statement on " + current().getString());
             switch (current().getSymbol()) {
                 case TK_IF: return parseIf();
                 case TK_LET: return parseLet(); 
@@ -431,6 +525,8 @@ class Parser {
                 case TK_CLASS: return parseClassDefinition();
                 case TK_WHILE: return parseWhile();
                 case TK_RETURN: return parseReturn();
+                case TK_BREAK:
+                case TK_CONTINUE: return parseLoopControl();
                 case TK_PRINTLN: return parsePrint();
                 case TK_LC: return parseBlock();
                 default: return parseExprStmt();
@@ -438,38 +534,32 @@ class Parser {
             return nullptr;
         }
         StatementList* parseStmtList() {
-            StatementList* sl = new StatementList(current());
-            while (!expect(TK_EOI)) {
-                if (expect(TK_RC)) {
-                    return sl;
-                }
-                sl->addStatement(parseStmt());
+            StatementList* sl = arena->make<StatementList>(current());
+            vector<StmtNode*> stmts;
+            while (!expect(TK_EOI) && !expect(TK_RC)) {
+                stmts.push_back(parseStmt());
                 if (expect(TK_SEMI)) advance();
             }
+            sl->setStatements(arena->array(stmts));
             return sl;
         }
-        void init(vector<Token>& tkns) {
-            int n = tkns.size();
-            tokens = new Token[n];
-            for (int i = 0; i < n; i++) {
-                tokens[i] = tkns[i];
-            }
-            num_tokens = n;
-            token_pos = 0;
-            dt = DepthTracker(loud);
-        }
-        bool loud;
     public:
-        Parser(vector<Token> tkns, bool trace) {
-            loud = trace;
-            init(tkns);
-        }
-        Parser() { loud = false;}
-        StatementList* parse(vector<Token> tkns, bool trace) {
-            init(tkns);
-            loud = trace;
+        Parser() {
+            tokens = nullptr;
+            arena = nullptr;
+        }
+        //every node is allocated from the given arena, the tree lives
+        //exactly as long as it does
+        StatementList* parse(CharBuffer* buffer, AstArena& nodes) {
+            TokenStream stream(buffer);
+            tokens = &stream;
+            arena = &nodes;
+            TRACE_RESET(TRACE_PARSER);
             StatementList* sl = parseStmtList();
-            if (loud) cout<<"Parse Complete."<<endl;
+            tokens = nullptr;
+            arena = nullptr;
+            TRACE_RESET(TRACE_PARSER);
+            TRACE(TRACE_PARSER, "Parse Complete.");
             return sl;
         }
 };
@@ -1,30 +1,137 @@
 #ifndef token_hpp
 #define token_hpp
 #include <iostream>
+#include <cstdint>
+#include <stdexcept>
 #include "lexer_matrix.h"
+#include "../intern.hpp"
 using namespace std;
 
-/*
-enum TKSymbol {
-    TK_NUMBER, TK_ID, TK_STRING, TK_LP, TK_RP, TK_LC, TK_RC, TK_LB, TK_RB,
-    TK_ASSIGN, TK_ADD, TK_SUB, TK_MUL, TK_DIV, TK_LT, TK_EQ, TK_GT, TK_LTE, TK_GTE, TK_NEQ,
-    TK_SEMI, TK_COMMA, TK_PERIOD, TK_PRINTLN, TK_LET, TK_WHILE, TK_IF, TK_ELSE,
-    TK_DEF, TK_RETURN,
-    TK_EOI
-};
-*/
+//fixed spelling of every token that isn't an identifier or a literal
+const char* tokenSpelling(TKSymbol symbol) {
+    switch (symbol) {
+        case TK_IF: return "if";
+        case TK_OR: return "or";
+        case TK_AND: return "and";
+        case TK_DEF: return "def";
+        case TK_GET: return "get";
+        case TK_LET: return "let";
+        case TK_MAP: return "map";
+        case TK_NEW: return "new";
+        case TK_POP: return "pop";
+        case TK_PUT: return "put";
+        case TK_NULL: return "nil";
+        case TK_ELSE: return "else";
+        case TK_PUSH: return "push";
+        case TK_SIZE: return "size";
+        case TK_TRUE: return "true";
+        case TK_KEYS: return "keys";
+        case TK_LAST: return "last";
+        case TK_FIRST: return "first";
+        case TK_REST: return "rest";
+        case TK_EMPTY: return "empty";
+        case TK_FLOOR: return "floor";
+        case TK_RANGE: return "range";
+        case TK_WHILE: return "while";
+        case TK_BREAK: return "break";
+        case TK_FALSE: return "false";
+        case TK_CLASS: return "class";
+        case TK_PUBLIC: return "public";
+        case TK_RANDOM: return "random";
+        case TK_APPEND: return "append";
+        case TK_FILTER: return "filter";
+        case TK_REDUCE: return "reduce";
+        case TK_RETURN: return "return";
+        case TK_DELETE: return "delete";
+        case TK_PRINTLN: return "println";
+        case TK_PRIVATE: return "private";
+        case TK_ORDERED: return "ordered";
+        case TK_CEILING: return "ceiling";
+        case TK_CONTINUE: return "continue";
+        case TK_CONTAINS: return "contains";
+        case TK_LP: return "(";
+        case TK_RP: return ")";
+        case TK_LC: return "{";
+        case TK_RC: return "}";
+        case TK_LB: return "[";
+        case TK_RB: return "]";
+        case TK_ADD: return "+";
+        case TK_SUB: return "-";
+        case TK_MUL: return "*";
+        case TK_DIV: return "/";
+        case TK_MOD: return "%";
+        case TK_ASSIGN: return ":=";
+        case TK_ASSIGN_SUM: return "+=";
+        case TK_ASSIGN_DIFF: return "-=";
+        case TK_MATCHRE: return "=~";
+        case TK_INCREMENT: return "++";
+        case TK_DECREMENT: return "--";
+        case TK_LT: return "<";
+        case TK_GT: return ">";
+        case TK_EQ: return "==";
+        case TK_NEQ: return "!=";
+        case TK_GTE: return ">=";
+        case TK_LTE: return "<=";
+        case TK_SEMI: return ";";
+        case TK_LAMBDA: return "&(";
+        case TK_PRODUCE: return "->";
+        case TK_COMMA: return ",";
+        case TK_COLON: return ":";
+        case TK_PERIOD: return ".";
+        case TK_EOI: return "<fin>";
+        default:
+            break;
+    }
+    return "<nil>";
+}
 
+//Tokens are copied into every AST node, so they're kept to 16 bytes of
+//plain data. Identifiers, strings and numbers carry the atom of their
+//text, everything else is spelled by its symbol, so the text is only
+//built when something asks for it and the source can go away once it's
+//parsed. The offset and line/column are kept for diagnostics. Atoms and
+//slots are signed 24 bits and scope depths signed 8 bits, a value that
+//doesn't fit throws instead of wrapping around to some other name.
 class Token {
     private:
-        TKSymbol symbol;
-        string strval;
-        int depth;
+        uint32_t offset;
+        int32_t atom:24;
+        int32_t depth:8;
+        int32_t slot:24;
+        uint32_t symbol:8;
+        uint32_t line:20;
+        uint32_t col:12;
+        static int checked(int value, int bits, const char* field) {
+            int limit = 1 << (bits - 1);
+            if (value < -limit || value >= limit)
+                throw overflow_error(string(field) + " " + to_string(value) + " doesn't fit in a token");
+            return value;
+        }
     public:
-        Token(TKSymbol sym = TK_EOI, string st = "<nil>") : symbol(sym), strval(st), depth(-1) { }
-        TKSymbol getSymbol() { return symbol; }
-        string getString() { return strval; }
+        Token(TKSymbol sym = TK_EOI, int id = -1) : offset(0), atom(checked(id, 24, "atom")), depth(-1), slot(-1), symbol(sym), line(0), col(0) { }
+        TKSymbol getSymbol() { return (TKSymbol)symbol; }
+        string getString() {
+            return atom >= 0 ? atoms.nameOf(atom):string(tokenSpelling(getSymbol()));
+        }
+        //atom of the text of identifiers, string and number literals, and of
+        //keywords spelled some other way than tokenSpelling (var, fn), -1 for everything else
+        int atomId() { return atom; }
         int scopeLevel() { return depth; }
-        void setScopeLevel(int level) { depth = level; }
+        void setScopeLevel(int level) { depth = checked(level, 8, "scope depth"); }
+        int slotIndex() { return slot; }
+        void setSlotIndex(int index) { slot = checked(index, 24, "slot"); }
+        //where the token started in its source, lines and columns count from 1
+        void setLocation(int off, int ln, int cl) {
+            offset = off;
+            line = ln < 0xfffff ? ln:0xfffff;
+            col = cl < 4095 ? cl:4095;
+        }
+        int sourceOffset() { return offset; }
+        int sourceLength() { return getString().size(); }
+        int lineNumber() { return line; }
+        int column() { return col; }
 };
 
-#endif
\ No newline at end of file
+static_assert(sizeof(Token) == 16, "Token should stay 16 bytes");
+
+#endif
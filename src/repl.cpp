@@ -1,64 +1,257 @@
 #include <iostream>
+#include <chrono>
 #include "parse/lexer.hpp"
 #include "parse/parser.hpp"
 #include "interpreter/prettyprint.hpp"
+#include "interpreter/optimize/passes.hpp"
 #include "interpreter/interpreter.hpp"
+#include "interpreter/vm/compiler.hpp"
+#include "interpreter/vm/vm.hpp"
+#include "interpreter/flat/flatten.hpp"
+#include "interpreter/flat/evaluator.hpp"
 using namespace std;
 
-void readEvalPrintLoop(bool loud) {
+enum Engine {
+    TREEWALK, BYTECODE, FLAT
+};
+
+//.trace on its own toggles every category, .trace <category> just that one
+void toggleTrace(string arg) {
+    if (arg.empty()) {
+        tracer.enable("all", !tracer.any());
+        return;
+    }
+    bool found = false;
+    for (int i = 0; i < TRACE_CATEGORIES; i++) {
+        if (traceCategoryNames[i] == arg) {
+            tracer.enable((TraceCategory)i, !tracer.on((TraceCategory)i));
+            found = true;
+        }
+    }
+    if (!found)
+        cout<<"Unknown trace category: "<<arg<<endl;
+}
+
+void readEvalPrintLoop(Engine engine, int optLevel) {
     bool running = true;
-    bool trace = loud;
-    Lexer lexer;
     Parser parser;
-    PrettyPrinter* pp = new PrettyPrinter(trace);
-    ScopeResolver* sr = new ScopeResolver(trace);
-    Interpreter* terp = new Interpreter();
+    PassManager passes;
+    addStandardPasses(passes, optLevel);
+    PrettyPrinter* pp = new PrettyPrinter();
+    //one pool for the session, later lines reuse earlier lines' literals
+    ConstantPool* constants = new ConstantPool();
+    ScopeResolver* sr = new ScopeResolver(constants);
+    Interpreter* terp = new Interpreter(constants);
+    Compiler* compiler = new Compiler();
+    VM* vm = new VM();
+    FlatTree* flat = new FlatTree();
+    Flattener* flattener = new Flattener();
+    FlatEvaluator* fe = new FlatEvaluator();
     StringBuffer* sb = new StringBuffer();
+    //functions defined on one line are called from later ones, so every
+    //line's tree is kept until the session ends
+    vector<AstArena*> units;
     while (running) {
         cout<<"mgcgs> ";
         string input;
         getline(cin, input);
         if (input == ".quit") {
             running = false;
-        } else if (input == ".trace") {
-            trace = !trace;
+        } else if (input.compare(0, 6, ".trace") == 0) {
+            toggleTrace(input.size() > 7 ? input.substr(7):"");
+        } else if (input == ".gc") {
+            heap.collect();
+            heap.printStats();
         } else {
             sb->init(input);
-            auto ast = parser.parse(lexer.tokenizeInput(sb), true);
-            sr->visit(ast);
-            if (trace)
+            units.push_back(new AstArena());
+            StatementList* ast;
+            try {
+                ast = parser.parse(sb, *units.back());
+                passes.run(ast, *units.back(), false);
+                sr->visit(ast);
+            } catch (overflow_error& e) {
+                cout<<"Error: "<<e.what()<<endl;
+                continue;
+            }
+            if (TRACING(TRACE_PARSER))
                 pp->visit(ast);
-            terp->visit(ast);
+            if (engine == BYTECODE) {
+                CodeObject* code = compiler->compile(ast);
+                if (TRACING(TRACE_INTERPRETER))
+                    code->dump();
+                vm->execute(code);
+            } else if (engine == FLAT) {
+                int from = flat->size();
+                int root = flattener->flatten(ast, flat);
+                if (TRACING(TRACE_INTERPRETER))
+                    flat->dump(from);
+                fe->execute(flat, root);
+            } else {
+                terp->execute(ast);
+            }
         }
     }
+    for (AstArena* unit : units)
+        delete unit;
+}
+
+//nullptr when the program is too big for a token's fields, the
+//error has been reported by then
+StatementList* parseAndResolve(CharBuffer* data, AstArena& arena, ConstantPool* constants, int optLevel) {
+    try {
+        Parser pp;
+        auto t = pp.parse(data, arena);
+        PassManager passes;
+        addStandardPasses(passes, optLevel);
+        passes.run(t, arena);
+        if (TRACING(TRACE_PARSER)) {
+            PrettyPrinter pv;
+            pv.visit(t);
+        }
+        ScopeResolver* sr = new ScopeResolver(constants);
+        sr->visit(t);
+        return t;
+    } catch (overflow_error& e) {
+        cout<<"Error: "<<e.what()<<endl;
+    }
+    return nullptr;
+}
+
+void execFromCmd(CharBuffer* data, Engine engine, int optLevel) {
+    AstArena arena;
+    ConstantPool constants;
+    auto t = parseAndResolve(data, arena, &constants, optLevel);
+    if (t == nullptr)
+        return;
+    if (engine == BYTECODE) {
+        Compiler compiler;
+        VM* vm = new VM();
+        vm->execute(compiler.compile(t));
+    } else if (engine == FLAT) {
+        FlatTree* flat = new FlatTree();
+        Flattener flattener;
+        int root = flattener.flatten(t, flat);
+        if (TRACING(TRACE_INTERPRETER))
+            flat->dump();
+        FlatEvaluator* fe = new FlatEvaluator();
+        fe->execute(flat, root);
+    } else {
+        Interpreter* ev = new Interpreter(&constants);
+        ev->execute(t);
+    }
 }
 
-void execFromCmd(CharBuffer* data) {
-    Lexer lexer;
-    Parser pp;
-    auto t = pp.parse(lexer.tokenizeInput(data), true);
-    PrettyPrinter* pv = new PrettyPrinter();
-    pv->visit(t);
-    ScopeResolver* sr = new ScopeResolver();
-    sr->visit(t);
-    Interpreter* ev = new Interpreter();
-    ev->visit(t);
+class NullBuffer : public streambuf {
+    public:
+        int overflow(int c) { return c; }
+};
+
+//runs the script under each engine with its output discarded and reports the timings.
+void benchmark(CharBuffer* data, int runs, int optLevel) {
+    AstArena arena;
+    ConstantPool constants;
+    auto t = parseAndResolve(data, arena, &constants, optLevel);
+    if (t == nullptr)
+        return;
+    Compiler compiler;
+    CodeObject* code = compiler.compile(t);
+    FlatTree flat;
+    Flattener flattener;
+    int root = flattener.flatten(t, &flat);
+    NullBuffer nb;
+    streambuf* out = cout.rdbuf(&nb);
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < runs; i++) {
+        Interpreter ev(&constants);
+        ev.execute(t);
+    }
+    auto mid = chrono::steady_clock::now();
+    for (int i = 0; i < runs; i++) {
+        VM vm;
+        vm.execute(code);
+    }
+    auto vmEnd = chrono::steady_clock::now();
+    for (int i = 0; i < runs; i++) {
+        FlatEvaluator fe;
+        fe.execute(&flat, root);
+    }
+    auto end = chrono::steady_clock::now();
+    cout.rdbuf(out);
+    double tw = chrono::duration<double, milli>(mid - start).count();
+    double bc = chrono::duration<double, milli>(vmEnd - mid).count();
+    double fl = chrono::duration<double, milli>(end - vmEnd).count();
+    cout<<"runs:      "<<runs<<endl;
+    cout<<"tree-walk: "<<tw<<"ms ("<<tw/runs<<"ms/run)"<<endl;
+    cout<<"bytecode:  "<<bc<<"ms ("<<bc/runs<<"ms/run, "<<tw/bc<<"x)"<<endl;
+    cout<<"flat tree: "<<fl<<"ms ("<<fl/runs<<"ms/run, "<<tw/fl<<"x)"<<endl;
+}
+
+void usage() {
+    cout<<"usage: ghost [-e vm|ast|flat] [-O0|-O1] [-b [runs]] [-g kb] [-s] [-t category,...] [-f file | code]"<<endl;
+    cout<<"trace categories: all";
+    for (int i = 0; i < TRACE_CATEGORIES; i++)
+        cout<<", "<<traceCategoryNames[i];
+    cout<<endl;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc > 1) {
-        CharBuffer* buff;
-        if (argv[1][0] == '-' && argv[1][1] == 'f') {
-            FileStringBuffer* fsb = new FileStringBuffer();
-            fsb->readFile(argv[2]);
-            buff = fsb;
+    Engine engine = BYTECODE;
+    CharBuffer* buff = nullptr;
+    int benchRuns = 0;
+    bool gcStats = false;
+    int optLevel = 1;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-f" && i+1 < argc) {
+            MappedFileBuffer* mfb = new MappedFileBuffer();
+            if (!mfb->readFile(argv[++i]))
+                return 1;
+            buff = mfb;
+        } else if (arg == "-e" && i+1 < argc) {
+            string name = argv[++i];
+            if (name == "ast") {
+                engine = TREEWALK;
+            } else if (name == "vm") {
+                engine = BYTECODE;
+            } else if (name == "flat") {
+                engine = FLAT;
+            } else {
+                usage();
+                return 1;
+            }
+        } else if (arg == "-b") {
+            benchRuns = 25;
+            if (i+1 < argc && isdigit(argv[i+1][0]))
+                benchRuns = atoi(argv[++i]);
+        } else if (arg == "-g" && i+1 < argc) {
+            heap.configure(atol(argv[++i]) * 1024, 2.0);
+        } else if (arg == "-O0" || arg == "-O1") {
+            optLevel = arg[2] - '0';
+        } else if (arg == "-s") {
+            gcStats = true;
+        } else if (arg == "-t" && i+1 < argc) {
+            if (!tracer.enableList(argv[++i])) {
+                usage();
+                return 1;
+            }
+        } else if (arg[0] == '-') {
+            usage();
+            return 1;
         } else {
             StringBuffer* sb = new StringBuffer();
-            sb->init(argv[1]);
+            sb->init(arg);
+            buff = sb;
         }
-        execFromCmd(buff);
+    }
+    if (buff == nullptr) {
+        readEvalPrintLoop(engine, optLevel);
+    } else if (benchRuns > 0) {
+        benchmark(buff, benchRuns, optLevel);
     } else {
-        readEvalPrintLoop(true);
+        execFromCmd(buff, engine, optLevel);
     }
+    if (gcStats)
+        heap.printStats();
     return 0;
-}
\ No newline at end of file
+}
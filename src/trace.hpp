@@ -0,0 +1,97 @@
+#ifndef trace_hpp
+#define trace_hpp
+#include <iostream>
+#include <string>
+using namespace std;
+
+enum TraceCategory {
+    TRACE_LEXER, TRACE_PARSER, TRACE_RESOLVER, TRACE_INTERPRETER, TRACE_REGEX,
+    TRACE_OPTIMIZER, TRACE_CATEGORIES
+};
+
+string traceCategoryNames[] = { "lexer", "parser", "resolver", "interpreter", "regex", "optimizer" };
+
+//Diagnostic output for each subsystem goes through one tracer, each
+//category can be switched on at runtime and keeps its own indentation.
+//The TRACE macros below compile to nothing when NDEBUG is defined, so
+//release builds don't even evaluate the message.
+class Tracer {
+    private:
+        unsigned int enabled;
+        int depth[TRACE_CATEGORIES];
+    public:
+        Tracer() {
+            enabled = 0;
+            for (int i = 0; i < TRACE_CATEGORIES; i++)
+                depth[i] = 0;
+        }
+        bool on(TraceCategory cat) {
+            return enabled & (1u << cat);
+        }
+        bool any() {
+            return enabled != 0;
+        }
+        void enable(TraceCategory cat, bool state = true) {
+            if (state) enabled |= (1u << cat);
+            else enabled &= ~(1u << cat);
+            depth[cat] = 0;
+        }
+        //accepts a category name or "all", returns false if it's neither
+        bool enable(const string& name, bool state = true) {
+            if (name == "all") {
+                for (int i = 0; i < TRACE_CATEGORIES; i++)
+                    enable((TraceCategory)i, state);
+                return true;
+            }
+            for (int i = 0; i < TRACE_CATEGORIES; i++) {
+                if (traceCategoryNames[i] == name) {
+                    enable((TraceCategory)i, state);
+                    return true;
+                }
+            }
+            return false;
+        }
+        //comma separated list of categories, as given on the command line
+        bool enableList(const string& names) {
+            size_t start = 0;
+            while (start <= names.size()) {
+                size_t end = names.find(',', start);
+                if (end == string::npos) end = names.size();
+                if (!enable(names.substr(start, end - start)))
+                    return false;
+                start = end + 1;
+            }
+            return true;
+        }
+        void enter(TraceCategory cat) {
+            depth[cat]++;
+        }
+        void leave(TraceCategory cat) {
+            if (depth[cat] > 0) depth[cat]--;
+        }
+        void reset(TraceCategory cat) {
+            depth[cat] = 0;
+        }
+        ostream& line(TraceCategory cat) {
+            for (int i = 0; i < depth[cat]; i++) cout<<" ";
+            return cout;
+        }
+};
+
+Tracer tracer;
+
+#ifndef NDEBUG
+#define TRACING(cat) (tracer.on(cat))
+#define TRACE(cat, msg) do { if (tracer.on(cat)) tracer.line(cat)<<msg<<endl; } while (0)
+#define TRACE_ENTER(cat, msg) do { tracer.enter(cat); TRACE(cat, msg); } while (0)
+#define TRACE_LEAVE(cat) tracer.leave(cat)
+#define TRACE_RESET(cat) tracer.reset(cat)
+#else
+#define TRACING(cat) (false)
+#define TRACE(cat, msg) do { } while (0)
+#define TRACE_ENTER(cat, msg) do { } while (0)
+#define TRACE_LEAVE(cat) do { } while (0)
+#define TRACE_RESET(cat) do { } while (0)
+#endif
+
+#endif